@@ -0,0 +1,359 @@
+/**
+MIT License
+Copyright (c) 2020 bbqz007 <https://github.com/bbqz007, http://www.cnblogs.com/bbqzsl>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+// runs every filter of createFilter headless over a few inputs and sizes,
+// prints ns/pixel and frames/s per filter and thread count, and writes
+// the same as json and csv to compare builds, e.g. opencv3 against opencv4.
+#include "cvtool.h"
+#include <iomanip>
+using namespace zhelper;
+using namespace cvtool;
+
+static const char usage[] =
+    "usage: cvbench [options] [input ...]\n"
+    "  inputs default to synthetic, images/apple-tree.awebp and images/SuperMario.mp4\n"
+    "  --sizes <h,...>      frame heights, default 480,1080,2160\n"
+    "  --threads <n,...>    cv::setNumThreads values, default 1,2,4,.. up to all cpus\n"
+    "  --iters <n>          timed runs per case, default 10\n"
+    "  --filters <a,...>    only these filters\n"
+    "  --json <file>        default cvbench.json\n"
+    "  --csv <file>         default cvbench.csv\n";
+
+struct options
+{
+    options() : iters(10), json("cvbench.json"), csv("cvbench.csv") {}
+    vector<int> sizes;
+    vector<int> threads;
+    int iters;
+    vector<string> filters;
+    string json;
+    string csv;
+    vector<string> inputs;
+};
+
+// what a filter needs in front of it to see the input it expects,
+// and trackbar values closer to real use than the defaults.
+struct bench_case
+{
+    const char* filter;
+    const char* head;
+    const char* label;
+    int value;
+};
+
+static const bench_case cases[] =
+{
+    { "threshold", "bgr2gray", 0, 0 },
+    { "morphology", "", "morphology", 3 },
+    { "Canny", "bgr2gray", "threshval-2", 150 },
+    { "HoughLines", "bgr2gray,Canny", "threshval", 300 },
+    { "HoughLinesP", "bgr2gray,Canny", 0, 0 },
+    { "HoughCircles", "bgr2gray,medianBlur", 0, 0 },
+    { "preCornerDetect", "bgr2gray", 0, 0 },
+    { "norm_minmax", "cornerHarris", 0, 0 },
+    { "gray2mask", "bgr2gray", 0, 0 },
+    { "deskew", "bgr2gray", 0, 0 },
+    { "distrans", "bgr2gray", 0, 0 },
+    { "range", "", "h2(b,h)", 90 },
+    { "convexHull", "bgr2gray,Canny", 0, 0 },
+    { "contours", "bgr2gray,Canny", 0, 0 },
+};
+
+static const bench_case& find_case(const string& filter)
+{
+    static const bench_case none = { "", "", 0, 0 };
+    string name = filter;
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        string c = cases[i].filter;
+        transform(c.begin(), c.end(), c.begin(), ::tolower);
+        if (name == c)
+            return cases[i];
+    }
+    return none;
+}
+
+struct result
+{
+    string input;
+    Size size;
+    string filter;
+    int threads;
+    double p50_ns;
+    double mean_ns;
+    string error;
+};
+
+static vector<int> parse_ints(const string& s)
+{
+    vector<int> v;
+    istringstream is(s);
+    string tok;
+    while (getline(is, tok, ','))
+        if (!tok.empty())
+            v.push_back(atoi(tok.c_str()));
+    return v;
+}
+
+static bool parse_args(int argc, char** argv, options& opt)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc)
+            opt.sizes = parse_ints(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc)
+            opt.threads = parse_ints(argv[++i]);
+        else if (arg == "--iters" && i + 1 < argc)
+            opt.iters = max(1, atoi(argv[++i]));
+        else if (arg == "--filters" && i + 1 < argc)
+        {
+            istringstream is(argv[++i]);
+            string tok;
+            while (getline(is, tok, ','))
+                opt.filters.push_back(tok);
+        }
+        else if (arg == "--json" && i + 1 < argc)
+            opt.json = argv[++i];
+        else if (arg == "--csv" && i + 1 < argc)
+            opt.csv = argv[++i];
+        else if (arg.size() > 1 && arg[0] == '-')
+            return false;
+        else
+            opt.inputs.push_back(arg);
+    }
+    if (opt.sizes.empty())
+        opt.sizes = parse_ints("480,1080,2160");
+    if (opt.threads.empty())
+    {
+        int cpus = max(1, getNumberOfCPUs());
+        for (int t = 1; t < cpus; t *= 2)
+            opt.threads.push_back(t);
+        opt.threads.push_back(cpus);
+    }
+    if (opt.filters.empty())
+        opt.filters = filter_names();
+    return true;
+}
+
+// noise under lines, circles and boxes, so edge, hough and contour
+// filters have something to find. the same on every run.
+static Mat synthetic()
+{
+    Mat img(1080, 1920, CV_8UC3);
+    RNG rng(20201117);
+    rng.fill(img, RNG::UNIFORM, Scalar::all(0), Scalar::all(64));
+    for (int i = 0; i < 60; ++i)
+    {
+        Scalar color(rng.uniform(64, 256), rng.uniform(64, 256), rng.uniform(64, 256));
+        Point p1(rng.uniform(0, img.cols), rng.uniform(0, img.rows));
+        Point p2(rng.uniform(0, img.cols), rng.uniform(0, img.rows));
+        switch (i % 3)
+        {
+        case 0: line(img, p1, p2, color, rng.uniform(1, 6), LINE_AA); break;
+        case 1: circle(img, p1, rng.uniform(10, 200), color, rng.uniform(1, 6), LINE_AA); break;
+        case 2: rectangle(img, p1, p2, color, FILLED); break;
+        }
+    }
+    return img;
+}
+
+static Mat load_input(const string& input)
+{
+    if (input == "synthetic")
+        return synthetic();
+    Mat img = imread(input, IMREAD_COLOR);
+    if (!img.empty())
+        return img;
+    // a video, take a frame past the fade in.
+    VideoCapture cap(input);
+    Mat frame;
+    for (int i = 0; i < 30 && cap.read(frame); ++i)
+        ;
+    return frame;
+}
+
+static result run_case(const string& input, const Mat& frame, const string& filter, int threads, int iters)
+{
+    result r;
+    r.input = input;
+    r.size = frame.size();
+    r.filter = filter;
+    r.threads = threads;
+    r.p50_ns = r.mean_ns = 0;
+    const bench_case& bc = find_case(filter);
+    string spec = bc.head;
+    spec += (spec.empty() ? "" : ",") + filter;
+    try
+    {
+        setNumThreads(threads);
+        filter_graph fg;
+        // time the filter itself, not a table composed with its head.
+        fg.fusion(false);
+        fg.open(spec);
+        if (fg.size() == 0)
+        {
+            r.error = "unknown filter";
+            return r;
+        }
+        const itf_filter& stage = fg.stage(fg.size() - 1);
+        for (size_t i = 0; bc.label && i < stage.params().size(); ++i)
+        {
+            if (stage.params()[i].label == bc.label)
+                *stage.params()[i].value = bc.value;
+        }
+        Mat in = frame;
+        // warm up caches, lazily built kernels and the output buffers.
+        fg.filter(in);
+        fg.filter(in);
+        fg.reset_stats();
+        for (int i = 0; i < iters; ++i)
+            fg.filter(in);
+        const latency_histogram& h = stage.stats().latency;
+        r.p50_ns = (double)h.percentile(.50);
+        r.mean_ns = h.mean();
+    }
+    catch (const cv::Exception& e)
+    {
+        r.error = e.what();
+        size_t nl = r.error.find('\n');
+        if (nl != string::npos)
+            r.error.resize(nl);
+    }
+    return r;
+}
+
+static void print_result(ostream& os, const result& r)
+{
+    double pixels = (double)r.size.width * r.size.height;
+    os << left << setw(24) << r.input.substr(0, 23)
+       << setw(11) << (to_string(r.size.width) + "x" + to_string(r.size.height))
+       << setw(24) << r.filter << right << setw(4) << r.threads;
+    if (!r.error.empty())
+        os << "  " << r.error << "\n";
+    else
+        os << fixed << setprecision(3)
+           << setw(12) << r.p50_ns * 1e-6
+           << setw(10) << r.p50_ns / pixels
+           << setw(10) << setprecision(1) << (r.p50_ns > 0 ? 1e9 / r.p50_ns : 0.) << "\n";
+    os.flush();
+}
+
+static bool write_json(const string& path, const vector<result>& results)
+{
+    FileStorage fs(path, FileStorage::WRITE);
+    if (!fs.isOpened())
+        return false;
+    fs << "opencv" << getVersionString();
+    fs << "cpus" << getNumberOfCPUs();
+    fs << "results" << "[";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const result& r = results[i];
+        double pixels = (double)r.size.width * r.size.height;
+        fs << "{" << "input" << r.input
+           << "width" << r.size.width << "height" << r.size.height
+           << "filter" << r.filter << "threads" << r.threads;
+        if (!r.error.empty())
+            fs << "error" << r.error;
+        else
+            fs << "p50_ns" << r.p50_ns << "mean_ns" << r.mean_ns
+               << "ns_per_pixel" << r.p50_ns / pixels
+               << "fps" << (r.p50_ns > 0 ? 1e9 / r.p50_ns : 0.);
+        fs << "}";
+    }
+    fs << "]";
+    return true;
+}
+
+static bool write_csv(const string& path, const vector<result>& results)
+{
+    ofstream os(path.c_str());
+    if (!os)
+        return false;
+    os << "opencv,input,width,height,filter,threads,p50_ns,mean_ns,ns_per_pixel,fps,error\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const result& r = results[i];
+        double pixels = (double)r.size.width * r.size.height;
+        string error = r.error;
+        replace(error.begin(), error.end(), ',', ';');
+        os << getVersionString() << "," << r.input << ","
+           << r.size.width << "," << r.size.height << ","
+           << r.filter << "," << r.threads << ",";
+        if (error.empty())
+            os << r.p50_ns << "," << r.mean_ns << "," << r.p50_ns / pixels << ","
+               << (r.p50_ns > 0 ? 1e9 / r.p50_ns : 0.) << ",\n";
+        else
+            os << ",,,," << error << "\n";
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    options opt;
+    if (!parse_args(argc, argv, opt))
+    {
+        cout << usage;
+        return -1;
+    }
+    if (opt.inputs.empty())
+    {
+        opt.inputs.push_back("synthetic");
+        opt.inputs.push_back("images/apple-tree.awebp");
+        opt.inputs.push_back("images/SuperMario.mp4");
+    }
+    itf_filter::headless() = true;
+    cout << "opencv " << getVersionString() << ", " << getNumberOfCPUs() << " cpus\n";
+    cout << left << setw(24) << "input" << setw(11) << "size" << setw(24) << "filter"
+         << right << setw(4) << "thr" << setw(12) << "p50 ms" << setw(10) << "ns/px"
+         << setw(10) << "fps" << "\n";
+    vector<result> results;
+    for (size_t i = 0; i < opt.inputs.size(); ++i)
+    {
+        Mat src = load_input(opt.inputs[i]);
+        if (src.empty())
+        {
+            cout << "skip " << opt.inputs[i] << ", can not read it" << endl;
+            continue;
+        }
+        for (size_t j = 0; j < opt.sizes.size(); ++j)
+        {
+            // 16:9 at the given height, so ns/pixel compares across inputs.
+            Size size((opt.sizes[j] * 16 / 9 + 1) & ~1, opt.sizes[j]);
+            Mat frame;
+            resize(src, frame, size, 0, 0, size.area() < src.size().area() ? INTER_AREA : INTER_LINEAR);
+            for (size_t k = 0; k < opt.filters.size(); ++k)
+            {
+                for (size_t t = 0; t < opt.threads.size(); ++t)
+                {
+                    results.push_back(run_case(opt.inputs[i], frame, opt.filters[k], opt.threads[t], opt.iters));
+                    print_result(cout, results.back());
+                }
+            }
+        }
+    }
+    if (!opt.json.empty() && !write_json(opt.json, results))
+        cout << "can not write " << opt.json << endl;
+    if (!opt.csv.empty() && !write_csv(opt.csv, results))
+        cout << "can not write " << opt.csv << endl;
+    return 0;
+}
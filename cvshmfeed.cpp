@@ -0,0 +1,156 @@
+/**
+MIT License
+Copyright (c) 2020 bbqz007 <https://github.com/bbqz007, http://www.cnblogs.com/bbqzsl>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+// feeds the frames of a video or image sequence into a shm_ring, for
+// cvtool shm:<name> to read without a file or a decoder in between,
+// as a capture process would.
+#include "cvtool.h"
+using namespace zhelper;
+using namespace cvtool;
+
+static const char usage[] =
+    "usage: cvshmfeed [options] <input> <name>\n"
+    "  <name> is the POSIX shared memory name, e.g. /cvtool, read as cvtool shm:/cvtool\n"
+    "  --slots <n>          frames in the ring, default 8\n"
+    "  --fps <n>            frames a second, default 25, 0 as fast as the reader\n"
+    "  --drop               overwrite frames not read yet instead of waiting for the reader\n"
+    "  --loop               start over at the end of the input\n";
+
+struct options
+{
+    options() : slots(8), fps(25.), drop(false), loop(false) {}
+    int slots;
+    double fps;
+    bool drop;
+    bool loop;
+    string input;
+    string name;
+};
+
+static bool parse_args(int argc, char** argv, options& opt)
+{
+    vector<string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--slots" && i + 1 < argc)
+            opt.slots = max(2, atoi(argv[++i]));
+        else if (arg == "--fps" && i + 1 < argc)
+            opt.fps = max(0., atof(argv[++i]));
+        else if (arg == "--drop")
+            opt.drop = true;
+        else if (arg == "--loop")
+            opt.loop = true;
+        else if (arg.size() > 1 && arg[0] == '-' && arg != "-")
+            return false;
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 2)
+        return false;
+    opt.input = args[0];
+    opt.name = args[1];
+    return true;
+}
+
+#ifndef _WIN32
+static sptr_source open_input(const string& input)
+{
+    vector<string> paths;
+    if (sequence_source::list(input, paths))
+        return sptr_source(new sequence_source(paths));
+    return sptr_source(new capture_source(input));
+}
+
+int main(int argc, char** argv)
+{
+    options opt;
+    if (!parse_args(argc, argv, opt))
+    {
+        cout << usage;
+        return -1;
+    }
+    sptr_source src = open_input(opt.input);
+    Mat frame;
+    if (!src->read(frame))
+    {
+        cout << "can not read " << opt.input << endl;
+        return -1;
+    }
+    // the ring has the format of the first frame, later ones are made to fit.
+    Size size = frame.size();
+    int type = frame.type();
+    shm_ring ring;
+    if (!ring.create(opt.name, size.height, size.width, type, opt.slots))
+    {
+        cout << "can not create " << opt.name << endl;
+        return -1;
+    }
+    cout << opt.name << ": " << size.width << "x" << size.height << " " << type_name(type)
+         << ", " << opt.slots << " slots" << endl;
+    chrono::steady_clock::duration period = chrono::duration_cast<chrono::steady_clock::duration>(
+        chrono::duration<double>(opt.fps > 0 ? 1. / opt.fps : 0.));
+    chrono::steady_clock::time_point due = chrono::steady_clock::now();
+    int64 n = 0;
+    int64 skipped = 0;
+    Mat fit;
+    for (;;)
+    {
+        if (frame.size() != size)
+        {
+            resize(frame, fit, size);
+            frame = fit;
+        }
+        if (frame.type() != type)
+        {
+            frame.convertTo(fit, type);
+            frame = fit;
+        }
+        if (!ring.write(frame, !opt.drop))
+        {
+            // e.g. another channel count, convertTo keeps it.
+            if (skipped++ == 0)
+                cout << "skip frames of another format" << endl;
+        }
+        else if (++n % 100 == 0)
+            cout << n << " frames" << endl;
+        if (opt.fps > 0)
+        {
+            due += period;
+            this_thread::sleep_until(due);
+        }
+        if (!src->read(frame))
+        {
+            if (!opt.loop || !src->seek(0) || !src->read(frame))
+                break;
+        }
+    }
+    cout << n << " frames -> " << opt.name;
+    if (skipped > 0)
+        cout << ", " << skipped << " skipped";
+    cout << endl;
+    return 0;
+}
+#else
+int main()
+{
+    cout << "cvshmfeed needs POSIX shared memory" << endl;
+    return -1;
+}
+#endif
@@ -18,6 +18,8 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 #include "cvtool.h"
+#include <opencv2/core/utils/filesystem.hpp>
+#include <iomanip>
 using namespace zhelper;
 using namespace cvtool;
 
@@ -27,15 +29,310 @@ extern "C" int __stdcall MessageBoxA(void*, const char*, const char*, int);
 #endif
 #endif
 
+static const char usage[] =
+    "Usage: cvtool [options] <img> <filter,...|params.yml>\n"
+    "  --headless <outdir>  no windows, run every frame, write results to <outdir>\n"
+    "  --params <file>      file saved by key 's' (default cvtool.yml)\n"
+    "  --pipeline <n>       headless, run the filters as <n> threads in a pipeline\n"
+    "  --replicas <k>       headless, run <k> copies of the graph on frames in parallel\n"
+    "  --stats <file.json>  dump per filter latency at exit\n"
+    "  --async              evaluate trackbar changes on a worker thread\n"
+    "  --proxy <side>       while dragging, evaluate at most <side> pixels wide (implies --async)\n"
+    "  --idle <ms>          full size evaluation after <ms> without changes, default 300\n"
+    "  --display <policy>   which windows redraw: all (default), top, fps[:n], demand\n"
+    "  --prefetch <n>       decode up to <n> frames ahead on a thread, default 8, 0 off\n"
+    "  --step <n>           frames the , and . keys jump, default 10\n"
+    "  --cache <MB>         keep recent frames and filter outputs, default 256, 0 off\n"
+    "  --vec <file> [WxH]   cut2/anno append positives to an opencv_createsamples .vec, default 24x24\n"
+    "  --record <file>      write the input and every filter output of each frame to <file>\n"
+    "  --replay <n>         <img> is a --record file, start from the output of filter <n>, 0 the input\n"
+    "  --video <file> [n]   headless, also encode the result, or the output of filter <n>, to a video\n"
+    "  --fps <n>            frame rate of --video, default 25\n"
+    "  --decoders <n>       threads decoding image sequences, globs, directories and lists, default cores\n"
+    "  --raw <WxH>[:fmt]    <img> - is raw frames of fmt gray, bgr (default) or bgra, else y4m\n";
+
+struct options
+{
+    options() : headless(false), params("cvtool.yml"), pipeline(0), replicas(0), async(false), proxy(0), idle(300),
+                display(filter_graph::display_all), display_fps(10.), prefetch(8), step(10), cache(256), replay(-1), video_stage(0), fps(25.), decoders(0), raw_type(CV_8UC3) {}
+    bool headless;
+    string outdir;
+    string params;
+    string input;
+    string graph;
+    int pipeline;
+    int replicas;
+    string stats;
+    bool async;
+    int proxy;
+    int idle;
+    filter_graph::display_mode display;
+    double display_fps;
+    int prefetch;
+    int step;
+    int cache;
+    string record;
+    // 1-based as the windows, 0 the recorded input, -1 not a replay.
+    int replay;
+    string video;
+    // 1-based, 0 the last filter.
+    int video_stage;
+    double fps;
+    int decoders;
+    // stdin as raw frames, y4m if empty.
+    Size raw;
+    int raw_type;
+};
+
+static bool parse_args(int argc, char** argv, options& opt)
+{
+    vector<string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--headless" && i + 1 < argc)
+        {
+            opt.headless = true;
+            opt.outdir = argv[++i];
+        }
+        else if (arg == "--params" && i + 1 < argc)
+            opt.params = argv[++i];
+        else if (arg == "--pipeline" && i + 1 < argc)
+            opt.pipeline = atoi(argv[++i]);
+        else if (arg == "--replicas" && i + 1 < argc)
+            opt.replicas = atoi(argv[++i]);
+        else if (arg == "--stats" && i + 1 < argc)
+            opt.stats = argv[++i];
+        else if (arg == "--async")
+            opt.async = true;
+        else if (arg == "--proxy" && i + 1 < argc)
+        {
+            opt.proxy = atoi(argv[++i]);
+            opt.async = true;
+        }
+        else if (arg == "--idle" && i + 1 < argc)
+            opt.idle = atoi(argv[++i]);
+        else if (arg == "--prefetch" && i + 1 < argc)
+            opt.prefetch = atoi(argv[++i]);
+        else if (arg == "--vec" && i + 1 < argc)
+        {
+            cut2_filter::vec_path() = argv[++i];
+            int w, h;
+            if (i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &w, &h) == 2 && w > 0 && h > 0)
+            {
+                cut2_filter::vec_size() = Size(w, h);
+                ++i;
+            }
+        }
+        else if (arg == "--cache" && i + 1 < argc)
+            opt.cache = max(0, atoi(argv[++i]));
+        else if (arg == "--video" && i + 1 < argc)
+        {
+            opt.video = argv[++i];
+            char* end = 0;
+            if (i + 1 < argc && argv[i + 1][0] != '\0')
+            {
+                long n = strtol(argv[i + 1], &end, 10);
+                if (*end == '\0' && n > 0)
+                {
+                    opt.video_stage = (int)n;
+                    ++i;
+                }
+            }
+        }
+        else if (arg == "--decoders" && i + 1 < argc)
+            opt.decoders = max(0, atoi(argv[++i]));
+        else if (arg == "--raw" && i + 1 < argc)
+        {
+            char fmt[16] = "bgr";
+            int w, h;
+            if (sscanf(argv[++i], "%dx%d:%15s", &w, &h, fmt) < 2 || w <= 0 || h <= 0)
+                return false;
+            opt.raw = Size(w, h);
+            if (!strcmp(fmt, "gray"))
+                opt.raw_type = CV_8UC1;
+            else if (!strcmp(fmt, "bgr"))
+                opt.raw_type = CV_8UC3;
+            else if (!strcmp(fmt, "bgra"))
+                opt.raw_type = CV_8UC4;
+            else
+                return false;
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+            opt.fps = atof(argv[++i]);
+        else if (arg == "--record" && i + 1 < argc)
+            opt.record = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+            opt.replay = max(0, atoi(argv[++i]));
+        else if (arg == "--step" && i + 1 < argc)
+            opt.step = max(1, atoi(argv[++i]));
+        else if (arg == "--display" && i + 1 < argc)
+        {
+            string policy = argv[++i];
+            if (policy == "all")
+                opt.display = filter_graph::display_all;
+            else if (policy == "top")
+                opt.display = filter_graph::display_top;
+            else if (policy.compare(0, 3, "fps") == 0)
+            {
+                opt.display = filter_graph::display_fps;
+                if (policy.size() > 4 && policy[3] == ':')
+                    opt.display_fps = atof(policy.c_str() + 4);
+            }
+            else if (policy == "demand")
+                opt.display = filter_graph::display_demand;
+            else
+                return false;
+        }
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 2)
+        return false;
+    opt.input = args[0];
+    opt.graph = args[1];
+    return true;
+}
+
+static bool is_params_file(const string& graph)
+{
+    static const char* exts[] = { "yml", "yaml", "xml", "json" };
+    size_t dot = graph.find_last_of('.');
+    if (dot == string::npos || dot == 0)
+        return false;
+    string ext = graph.substr(dot + 1);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i)
+    {
+        if (ext == exts[i])
+            return true;
+    }
+    return false;
+}
+
+static void write_result(const options& opt, int n, const Mat& res)
+{
+    if (res.empty())
+        return;
+    ostringstream os;
+    os << opt.outdir << "/" << setw(6) << setfill('0') << n << ".png";
+    try
+    {
+        imwrite(os.str(), res);
+    }
+    catch (const cv::Exception& e)
+    {
+        cout << os.str() << ": " << e.what() << endl;
+    }
+}
+
+// feeds every frame to a filter_pipeline or filter_replicas,
+// results are written by a sink thread in the order of the frames.
+template<typename Runner>
+static int run_streaming(Runner& runner, itf_source& src, video_sink* video, const options& opt)
+{
+    thread sink([&](){
+        Mat res;
+        int i = 0;
+        while (runner.pop(res))
+        {
+            if (video)
+                video->push(res);
+            write_result(opt, i++, res);
+        }
+    });
+    int n = 0;
+    for (;;)
+    {
+        // a fresh Mat per frame, the decoder must not reuse one still in flight.
+        Mat frame;
+        if (!src.read(frame))
+            break;
+        runner.push(frame);
+        ++n;
+    }
+    runner.close();
+    sink.join();
+    return n;
+}
+
+// the graph over a frame, or in a replay the stages after opt.replay over
+// its recorded output.
+static Mat filter_frame(filter_graph& fg, frame_store* store, Mat& frame, int64 index, const options& opt)
+{
+    if (!store || opt.replay == 0)
+        return fg.filter(frame, index);
+    return fg.filter_from(opt.replay - 1, frame, store->get(index, -1), index);
+}
+
+static int run_headless(filter_graph& fg, itf_source& src, frame_store* store, const options& opt)
+{
+    utils::fs::createDirectories(opt.outdir);
+    shared_ptr<video_sink> video;
+    if (!opt.video.empty())
+    {
+        if (opt.video_stage > 0 && (opt.pipeline > 0 || opt.replicas > 0))
+            cout << "--pipeline and --replicas encode the result only" << endl;
+        video = make_shared<video_sink>(opt.video, opt.fps);
+    }
+    int n = 0;
+    if (opt.replicas > 0)
+    {
+        filter_replicas replicas(fg, opt.replicas);
+        n = run_streaming(replicas, src, video.get(), opt);
+        for (size_t i = 0; i < replicas.size(); ++i)
+            fg.merge_stats(replicas.replica(i));
+    }
+    else if (opt.pipeline > 0)
+    {
+        filter_pipeline pipe(fg, opt.pipeline);
+        n = run_streaming(pipe, src, video.get(), opt);
+    }
+    else
+    {
+        Mat frame;
+        size_t stage = opt.video_stage > 0 ? (size_t)opt.video_stage - 1 : fg.size();
+        if (video)
+            fg.tap(stage);
+        while (src.read(frame))
+        {
+            Mat res = filter_frame(fg, store, frame, src.position(), opt);
+            // pushed before the png is written, the encoder runs meanwhile.
+            if (video)
+                video->push(stage + 1 < fg.size() ? fg.output(stage) : res);
+            write_result(opt, n, res);
+            ++n;
+        }
+    }
+    cout << n << " frames -> " << opt.outdir << ", " << src.underruns() << " underruns" << endl;
+    if (video)
+    {
+        video->close();
+        if (video->failed())
+            cout << "can not write " << opt.video << endl;
+        else
+            cout << video->written() << " frames -> " << opt.video << ", " << video->dropped() << " dropped" << endl;
+    }
+    fg.print_stats(cout);
+    return 0;
+}
+
+static void dump_stats(const filter_graph& fg, const options& opt)
+{
+    if (!opt.stats.empty() && !fg.dump_stats(opt.stats))
+        cout << "can not write " << opt.stats << endl;
+}
+
 int main(int argc, char** argv)
 {
-    cout << "Usage: cvtool <img> <filter,...>\n";
-	if (argc != 3)
+    cout << usage;
+    options opt;
+	if (!parse_args(argc, argv, opt))
 	{
 		if (argc == 1)
 		{
 #ifdef _WIN32
-			::MessageBoxA(NULL, "Usage: cvtool <img> <filter,...>\n", "cvtool usgaes", 1);
+			::MessageBoxA(NULL, usage, "cvtool usgaes", 1);
 #else
 			std::string message = "Usage: cvtool <img> <filter,...>\n";
 			Mat img = cv::Mat::zeros(cv::Size(800, 60), CV_8UC3);
@@ -61,21 +358,136 @@ int main(int argc, char** argv)
 		return -1;
 	}
 
+    if ((opt.pipeline > 0 || opt.replicas > 0) && !opt.headless)
+    {
+        cout << "--pipeline and --replicas need --headless" << endl;
+        return -1;
+    }
+    if ((opt.pipeline > 0 || opt.replicas > 0) && (opt.replay >= 0 || !opt.record.empty()))
+    {
+        cout << "--record and --replay can not run with --pipeline or --replicas" << endl;
+        return -1;
+    }
+    itf_filter::headless() = opt.headless;
     filter_graph fg;
-    fg.open(argv[2]);
-    VideoCapture cap;
-    cap.open(argv[1]);
+    if (is_params_file(opt.graph))
+    {
+        if (!fg.load(opt.graph))
+        {
+            cout << "can not load " << opt.graph << endl;
+            return -1;
+        }
+    }
+    else
+        fg.open(opt.graph);
+    sptr_source src;
+    shared_ptr<frame_store> store;
+    vector<string> paths;
+    // a shared memory ring can not seek, and its slots are overwritten.
+    bool live = false;
+    // the console can not be asked for a frame number.
+    bool piped = opt.input == "-" || opt.input == "y4m:-";
+    if (opt.replay >= 0)
+    {
+        store = make_shared<frame_store>(opt.input, false);
+        if (!store->is_open())
+        {
+            cout << "can not open " << opt.input << endl;
+            return -1;
+        }
+        if (opt.replay > (int)fg.size())
+            opt.replay = (int)fg.size();
+        // the outputs are mapped, no decoding to prefetch.
+        src = sptr_source(new store_source(store, opt.replay - 1));
+        cout << src->frame_count() << " frames recorded in " << opt.input << endl;
+    }
+    else if (piped)
+    {
+        shared_ptr<stdin_source> in = make_shared<stdin_source>(opt.input == "-" ? opt.raw : Size(), opt.raw_type);
+        if (!in->isOpened())
+        {
+            cout << "can not read frames from stdin" << endl;
+            return -1;
+        }
+        cout << "stdin: " << in->size().width << "x" << in->size().height << endl;
+        src = in;
+        // reads overlap filtering as a decoder would.
+        if (opt.prefetch > 0)
+            src = sptr_source(new prefetch_source(src, opt.prefetch));
+    }
+#ifndef _WIN32
+    else if (opt.input.compare(0, 4, "shm:") == 0)
+    {
+        // slots are handed out as they are, frames in flight at once need copies.
+        shared_ptr<shm_source> shm = make_shared<shm_source>(opt.input.substr(4), opt.pipeline > 0 || opt.replicas > 0 || opt.async);
+        if (!shm->is_open())
+        {
+            cout << "can not attach " << opt.input << endl;
+            return -1;
+        }
+        cout << opt.input << ": " << shm->size().width << "x" << shm->size().height << endl;
+        src = shm;
+        live = true;
+    }
+#endif
+    else if (sequence_source::list(opt.input, paths))
+    {
+        // decoded ahead by its own threads already.
+        src = sptr_source(new sequence_source(paths, opt.decoders, opt.prefetch));
+        cout << paths.size() << " images in " << opt.input << endl;
+    }
+    else
+    {
+        src = sptr_source(new capture_source(opt.input));
+        if (opt.prefetch > 0)
+            src = sptr_source(new prefetch_source(src, opt.prefetch));
+    }
+    if (!opt.record.empty())
+    {
+        if (opt.record == opt.input)
+        {
+            cout << "can not record to the replayed file" << endl;
+            return -1;
+        }
+        shared_ptr<frame_store> recorder = make_shared<frame_store>(opt.record, true);
+        if (!recorder->is_open())
+        {
+            cout << "can not write " << opt.record << endl;
+            return -1;
+        }
+        fg.record(recorder);
+    }
+    if (opt.headless)
+    {
+        int ret = run_headless(fg, *src, store.get(), opt);
+        dump_stats(fg, opt);
+        return ret;
+    }
+    shared_ptr<frame_cache> cache;
+    if (opt.cache > 0 && !live)
+    {
+        cache = make_shared<frame_cache>((size_t)opt.cache << 20);
+        src = sptr_source(new cache_source(src, cache));
+        fg.cache(cache);
+    }
+    fg.proxy(opt.proxy, opt.idle);
+    fg.display_policy(opt.display, opt.display_fps);
+    fg.async(opt.async);
     Mat frame;
     char c = '\0';
-    while((cap >> frame, !frame.empty())
+    while(src->read(frame)
           && (c != 'q' && c != 'Q'))
     {
         {
             Mat res;
-            res = fg.filter(frame);
+            res = filter_frame(fg, store.get(), frame, src->position(), opt);
+            // the worker may still read it, let the decoder take a new buffer.
+            if (opt.async)
+                frame.release();
             do
 			{
-            	c = waitKey(0);
+            	c = waitKey(opt.async || opt.display == filter_graph::display_fps ? 15 : 0);
+				fg.present();
 				switch (c)
 				{
 				case '1':case '2':case '3':case '4':case '5':case '6':
@@ -85,11 +497,54 @@ int main(int argc, char** argv)
 				case '=':
 					fg.bringTop();
 					break;
+				case 's':
+					if (fg.save(opt.params))
+						cout << "saved " << opt.params << endl;
+					break;
+				case 't':
+					fg.print_stats(cout);
+					if (cache)
+						cache->print_stats(cout);
+					break;
+				case 'r':
+					fg.refresh();
+					break;
+				case ',':
+				case '.':
+				case 'g':
+					{
+						int64 to = src->position() + (c == ',' ? -opt.step : opt.step);
+						if (c == 'g' && piped)
+						{
+							cout << "stdin is the input, can not type a frame number" << endl;
+							break;
+						}
+						if (c == 'g')
+						{
+							cout << "goto frame (of " << src->frame_count() << "): " << flush;
+							if (!(cin >> to))
+							{
+								cin.clear();
+								cin.ignore(1 << 20, '\n');
+								break;
+							}
+						}
+						// as space, the next frame read is the one sought.
+						if (src->seek(max(to, (int64)0)))
+							c = ' ';
+						else
+							cout << "can not seek" << endl;
+					}
+					break;
 				}
         	} while (c != 'q'
                		&& c != 'Q'
                		&& c != ' ');
 		}
     }
+    if (cache)
+        cache->print_stats(cout);
+    sample_writer::instance().flush();
+    dump_stats(fg, opt);
     return 0;
 }
@@ -28,6 +28,8 @@ SOFTWARE.
 #include <opencv2/objdetect.hpp>
 #include <opencv2/features2d.hpp>
 #include <opencv2/cvconfig.h>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <opencv2/core/hal/intrin.hpp>
 
 //#include <opencv2/imgcodecs.hpp>
 #include <string>
@@ -37,7 +39,25 @@ SOFTWARE.
 #include <memory>
 #include <vector>
 #include <map>
+#include <list>
+#include <deque>
 #include <algorithm>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#endif
 using namespace cv;
 using namespace std;
 
@@ -61,2635 +81,6359 @@ namespace cvtool
 
 class itf_filter;
 itf_filter* createFilter(const char* filter, const string& name);
+const vector<string>& filter_names();
 
-class filter_graph;
-class itf_filter
+// the filters createFilter builds by name, X(name) constructs name_filter.
+#define CVTOOL_FILTERS(X)   \
+    X(threshold)    \
+    X(morphology)   \
+    X(Canny)    \
+    X(medianBlur)   \
+    X(GaussianBlur) \
+    X(blur) \
+    X(bilateral)    \
+    X(box)  \
+    X(sqrBox)   \
+    X(Sobel)    \
+    X(Scharr)   \
+    X(Laplacian)    \
+    X(pyrDown)  \
+    X(pyrUp)    \
+    X(warpAffine)   \
+    X(warpPerspective)  \
+    X(warpPolar)    \
+    X(cornerMinEigenVal)    \
+    X(cornerHarris) \
+    X(cornerEigenValsAndVecs)   \
+    X(preCornerDetect)  \
+    X(norm_minmax)  \
+    X(HoughLines)   \
+    X(HoughLinesP)  \
+    X(HoughCircles) \
+    X(channel)  \
+    X(bgr2gray) \
+    X(gray2mask)    \
+    X(range)    \
+    X(colormap) \
+    X(cut)  \
+    X(cut2) \
+    X(anno) \
+    X(crop) \
+    X(zoom) \
+    X(feature)  \
+    X(blob) \
+    X(deskew)   \
+    X(dem)  \
+    X(distrans) \
+    X(convexHull)   \
+    X(contours) \
+    X(match)    \
+    X(cascade)
+
+// bounded lock-free queue, one producer thread and one consumer thread.
+// push and pop spin a little, then sleep until the other side moves.
+template<typename T>
+class spsc_queue
 {
 public:
-    itf_filter(const string& name) : num_(++snum_)
+    explicit spsc_queue(size_t capacity)
+        : ring_(capacity + 1), head_(0), tail_(0), waiting_(0)
     {
-        ostringstream os;
-        os << num_ << ": " << name << " -=>@github.com/bbqz007";
-        name_ = os.str();
-        namedWindow(name_);
     }
-	itf_filter(const string& name, const string& comment) : num_(++snum_)
-	{
-		ostringstream os;
-		os << num_ << ": " << name << comment << " -=>@github.com/bbqz007";
-		name_ = os.str();
-		namedWindow(name_);
-	}
-    virtual ~itf_filter()
+    bool try_push(const T& v)
     {
-        destroyWindow(name_);
+        size_t tail = tail_.load(memory_order_relaxed);
+        size_t next = (tail + 1) % ring_.size();
+        if (next == head_.load(memory_order_acquire))
+            return false;
+        ring_[tail] = v;
+        tail_.store(next, memory_order_release);
+        wake_();
+        return true;
     }
-    Mat filter(Mat& image)
+    bool try_pop(T& v)
     {
-        return _filter(image);
+        size_t head = head_.load(memory_order_relaxed);
+        if (head == tail_.load(memory_order_acquire))
+            return false;
+        v = ring_[head];
+        ring_[head] = T();
+        head_.store((head + 1) % ring_.size(), memory_order_release);
+        wake_();
+        return true;
+    }
+    void push(const T& v)
+    {
+        for (int i = 0; !try_push(v); ++i)
+        {
+            if (i < spins)
+                this_thread::yield();
+            else
+                park_([this](){ return (tail_.load() + 1) % ring_.size() != head_.load(); });
+        }
+    }
+    void pop(T& v)
+    {
+        for (int i = 0; !try_pop(v); ++i)
+        {
+            if (i < spins)
+                this_thread::yield();
+            else
+                park_([this](){ return head_.load() != tail_.load(); });
+        }
     }
-	void bringTop()
-	{
-		setWindowProperty(name_, 5, 0);
-	}
 protected:
-    static const Scalar& next_color(bool reset = false)
+    static const int spins = 64;
+    // waiting_ is raised before ready is checked and read after the
+    // index is stored, both sequentially consistent, so a wake is never
+    // missed; the timeout is only a backstop.
+    template<typename Ready>
+    void park_(Ready ready)
     {
-        static const Scalar colors[] =
+        unique_lock<mutex> lock(mutex_);
+        waiting_.fetch_add(1);
+        cond_.wait_for(lock, chrono::milliseconds(50), ready);
+        waiting_.fetch_sub(1);
+    }
+    void wake_()
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (waiting_.load() > 0)
         {
-            Scalar(0,0,0),
-            Scalar(255,0,0),
-            Scalar(255,128,0),
-            Scalar(255,255,0),
-            Scalar(0,255,0),
-            Scalar(0,128,255),
-            Scalar(0,255,255),
-            Scalar(0,0,255),
-            Scalar(255,0,255)
-        };
-        static const int limits = sizeof(colors) / sizeof(Scalar);
-        static int i = 0;
-        if (reset)
-            i = 0;
-        return colors[++i%limits];
+            lock_guard<mutex> lock(mutex_);
+            cond_.notify_all();
+        }
     }
-    static void update_(int pos, void* userdata);
-    void update_next_(Mat image);
-    virtual Mat _filter(Mat& image) = 0;
-    string name_;
-    const int num_;
-    static int snum_;
-    filter_graph* graph_;
-    friend class filter_graph;
+    vector<T> ring_;
+    atomic<size_t> head_;
+    char pad_[64];
+    atomic<size_t> tail_;
+    atomic<int> waiting_;
+    mutex mutex_;
+    condition_variable cond_;
 };
 
-typedef shared_ptr<itf_filter> sptr_filter;
-
-class filter_graph
+// log-linear buckets, 8 per power of two, so any percentile is
+// within 12.5% of the exact value.
+class latency_histogram
 {
 public:
-    Mat filter(Mat& image)
+    latency_histogram() : counts_(8 * 62, 0), count_(0), max_(0), sum_(0) {}
+    void add(int64 ns)
     {
-        tmp_ = image;
-        return filter();
+        uint64 v = (uint64)max(ns, (int64)0);
+        ++counts_[bucket(v)];
+        ++count_;
+        sum_ += v;
+        if (v > max_)
+            max_ = v;
     }
-    void open(const string& cmd);
-    void push(sptr_filter& filter)
+    void merge(const latency_histogram& other)
     {
-        if (filter)
-        {
-            filter->graph_ = this;
-            filters_.push_back(filter);
-        }
-
+        for (size_t b = 0; b < counts_.size(); ++b)
+            counts_[b] += other.counts_[b];
+        count_ += other.count_;
+        sum_ += other.sum_;
+        max_ = max(max_, other.max_);
     }
-    filter_graph& apply(function<void(Mat)> f)
+    int64 count() const { return count_; }
+    int64 max_value() const { return (int64)max_; }
+    double mean() const { return count_ ? (double)sum_ / count_ : 0.; }
+    int64 percentile(double p) const
     {
-        apply_ = f;
-        return *this;
+        if (!count_)
+            return 0;
+        uint64 rank = (uint64)ceil(p * count_);
+        uint64 seen = 0;
+        for (size_t b = 0; b < counts_.size(); ++b)
+        {
+            seen += counts_[b];
+            if (seen >= rank)
+                return (int64)min(upper(b), max_);
+        }
+        return (int64)max_;
     }
-    Mat origin() { return (retmp_.empty())?tmp_:retmp_; }
-    void update_origin(Mat m) { retmp_ = m; }
-	void bringTop(int i)
-	{
-		if (i < filters_.size())
-			filters_[i]->bringTop();
-	}
-	void bringTop()
-	{
-		if (!filters_.empty())
-			filters_.back()->bringTop();
-	}
 protected:
-    Mat filter()
+    static size_t bucket(uint64 v)
     {
-        Mat res = tmp_;
-        for_each(filters_.begin(), filters_.end(),
-                 [&](sptr_filter& filter){
-                    res = filter->filter(res);
-                 });
-        if (apply_)
-            apply_(res);
-        return res;
+        if (v < 8)
+            return (size_t)v;
+        int msb = 3;
+        while (v >> (msb + 1))
+            ++msb;
+        return (msb - 2) * 8 + ((v >> (msb - 3)) & 7);
     }
-    void filter_next(itf_filter* f, Mat image)
+    static uint64 upper(size_t b)
     {
-        Mat res;
-        auto it = filters_.begin();
-        for(int i = 0; i < filters_.size(); ++i, ++it)
-        {
-            if (filters_[i].get() == f)
-            {
-                break;
-            }
-        }
-        if (it != filters_.end())
-        {
-            res = image;
-            for_each(++it, filters_.end(),
-                 [&](sptr_filter& filter){
-                    res = filter->filter(res);
-                 });
-            if (apply_)
-                apply_(res);
-        }
+        if (b < 8)
+            return b;
+        int shift = (int)(b / 8) - 1;
+        return ((8 + b % 8 + (uint64)1) << shift) - 1;
     }
-    friend class itf_filter;
-    vector<sptr_filter> filters_;
-    Mat tmp_;
-    Mat retmp_;
-    function<void(Mat)> apply_;
+    vector<uint64> counts_;
+    int64 count_;
+    uint64 max_;
+    uint64 sum_;
 };
 
-void itf_filter::update_(int pos, void* userdata)
-{
-    itf_filter* f = (itf_filter*)userdata;
-    if (f)
-        f->graph_->filter();
-}
-
-void itf_filter::update_next_(Mat image)
+struct stage_stats
 {
-    graph_->filter_next(this, image);
-}
-
-int itf_filter::snum_ = 0;
+    stage_stats() : type(-1), reused(0), allocated(0) {}
+    latency_histogram latency;
+    Size size;
+    int type;
+    // calls whose output went into a recycled buffer, or needed a new one.
+    int64 reused;
+    int64 allocated;
+};
 
-class noop_filter : public itf_filter
+// LRU of decoded frames and stage outputs within a byte budget, keyed by
+// frame number, stage (-1 for the decoded frame) and parameter version.
+// entries share the buffers they were given, so while a stage output is
+// cached itf_filter::output_() finds it held and allocates a new one;
+// with a cache every stage output is a fresh buffer, see --cache 0.
+class frame_cache
 {
 public:
-    noop_filter(const string& name) : itf_filter(name)
+    struct key
+    {
+        int64 frame;
+        int stage;
+        int64 version;
+        bool operator<(const key& o) const
+        {
+            if (frame != o.frame)
+                return frame < o.frame;
+            if (stage != o.stage)
+                return stage < o.stage;
+            return version < o.version;
+        }
+    };
+    // the output, what its window showed and the origin after the stage.
+    struct entry
+    {
+        Mat out;
+        Mat shown;
+        Mat origin;
+    };
+    explicit frame_cache(size_t budget)
+        : budget_(budget), bytes_(0), hits_(0), misses_(0), evictions_(0)
     {
-        noop_ = 128;
-        createTrackbar("noop", name_, &noop_, 256, itf_filter::update_, this);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    bool get(const key& k, entry& e)
     {
-        Mat res;
-        (void)image;
-        return res;
+        lock_guard<mutex> lock(mutex_);
+        map<key, lru::iterator>::iterator it = index_.find(k);
+        if (it == index_.end())
+        {
+            ++misses_;
+            return false;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        e = it->second->second;
+        ++hits_;
+        return true;
     }
-    int noop_;
-};
-
-class threshold_filter : public itf_filter
-{
-public:
-    threshold_filter(const string& name) : itf_filter(name)
+    void put(const key& k, const entry& e)
     {
-        threshval_ = 128;
-        createTrackbar("threshval", name_, &threshval_, 255, itf_filter::update_, this);
+        size_t n = bytes(e);
+        if (n > budget_)
+            return;
+        lock_guard<mutex> lock(mutex_);
+        map<key, lru::iterator>::iterator it = index_.find(k);
+        if (it != index_.end())
+        {
+            bytes_ -= bytes(it->second->second);
+            lru_.erase(it->second);
+            index_.erase(it);
+        }
+        while (!lru_.empty() && bytes_ + n > budget_)
+        {
+            bytes_ -= bytes(lru_.back().second);
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+            ++evictions_;
+        }
+        lru_.push_front(make_pair(k, e));
+        index_[k] = lru_.begin();
+        bytes_ += n;
     }
+    void print_stats(ostream& os) const
+    {
+        lock_guard<mutex> lock(mutex_);
+        os << "cache: " << hits_ << " hits, " << misses_ << " misses, "
+           << evictions_ << " evictions, " << index_.size() << " entries, "
+           << (bytes_ >> 20) << "/" << (budget_ >> 20) << " MB" << endl;
+    }
+    int64 hits() const { lock_guard<mutex> lock(mutex_); return hits_; }
+    int64 misses() const { lock_guard<mutex> lock(mutex_); return misses_; }
+    int64 evictions() const { lock_guard<mutex> lock(mutex_); return evictions_; }
+    size_t size_bytes() const { lock_guard<mutex> lock(mutex_); return bytes_; }
 protected:
-    virtual Mat _filter(Mat& image)
+    typedef list<pair<key, entry> > lru;
+    // Mats sharing data, like an output shown as is, count once.
+    static size_t bytes(const entry& e)
     {
-        Mat bw = threshval_ < 128 ? (image < threshval_) : (image > threshval_);
-        imshow(name_, bw);
-        return bw;
+        size_t n = e.out.total() * e.out.elemSize();
+        if (e.shown.data != e.out.data)
+            n += e.shown.total() * e.shown.elemSize();
+        if (e.origin.data != e.out.data && e.origin.data != e.shown.data)
+            n += e.origin.total() * e.origin.elemSize();
+        return n;
     }
-    int threshval_;
+    size_t budget_;
+    size_t bytes_;
+    int64 hits_;
+    int64 misses_;
+    int64 evictions_;
+    lru lru_;
+    map<key, lru::iterator> index_;
+    mutable mutex mutex_;
 };
 
-class Canny_filter : public itf_filter
+// the sample file of opencv_createsamples and opencv_traincascade: int
+// count, int w*h, short 0, short 0, then per sample a 0 byte and w*h
+// shorts of gray values. an existing file of the same size is appended.
+class vec_file
 {
 public:
-    Canny_filter(const string& name) : itf_filter(name)
+    vec_file(const string& path, Size size) : size_(size), count_(0)
     {
-        threshval1_ = 0;
-        threshval2_ = 50;
-        aperturesize_ = 5;
-        l2gradient_ = 0;
-        createTrackbar("threshval-1", name_, &threshval1_, 255, itf_filter::update_, this);
-        createTrackbar("threshval-2", name_, &threshval2_, 255, itf_filter::update_, this);
-        createTrackbar("aperture size |1", name_, &aperturesize_, 7, itf_filter::update_, this);
-        createTrackbar("L2 gradient (OFF/ON)", name_, &l2gradient_, 1, itf_filter::update_, this);
-        setTrackbarMin("aperture size |1", name_, 3);
-        setTrackbarMax("aperture size |1", name_, 7);
+        f_.open(path.c_str(), ios_base::in|ios_base::out|ios_base::binary);
+        if (!f_.is_open())
+        {
+            f_.clear();
+            f_.open(path.c_str(), ios_base::out|ios_base::binary);
+            f_.close();
+            f_.open(path.c_str(), ios_base::in|ios_base::out|ios_base::binary);
+            if (f_.is_open())
+                write_header();
+            return;
+        }
+        int header[2] = { 0, 0 };
+        f_.read((char*)header, sizeof(header));
+        if (!f_ || header[1] != size_.area())
+        {
+            cout << path << " is not a .vec of " << size_.width << "x" << size_.height << endl;
+            f_.close();
+            return;
+        }
+        count_ = header[0];
+        f_.seekp(0, ios_base::end);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    ~vec_file()
     {
-        Mat res;
-        Canny(image, res, threshval1_, threshval2_, aperturesize_|1, l2gradient_);
-        imshow(name_, res);
-        return res;
+        flush();
     }
-    int threshval1_;
-    int threshval2_;
-    int aperturesize_;
-    int l2gradient_;
-};
-
-class HoughLines_filter : public itf_filter
-{
-public:
-    HoughLines_filter(const string& name) : itf_filter(name)
+    bool is_open() const { return f_.is_open(); }
+    int count() const { return count_; }
+    // rect of image, gray and resized to the training window.
+    void append(const Mat& image, Rect rect)
     {
-        rho_ = 10;
-        theta_ = 1;
-        threshval_ = 150;
-        createTrackbar("rho*.1", name_, &rho_, 100, itf_filter::update_, this);
-        createTrackbar("theta angle", name_, &theta_, 180, itf_filter::update_, this);
-        createTrackbar("threshval", name_, &threshval_, 1000, itf_filter::update_, this);
-        setTrackbarMin("theta angle", name_, 1);
+        rect &= Rect(0, 0, image.cols, image.rows);
+        if (!is_open() || rect.area() == 0)
+            return;
+        Mat gray, sample;
+        if (image.channels() == 3)
+            cvtColor(image(rect), gray, COLOR_BGR2GRAY);
+        else if (image.channels() == 4)
+            cvtColor(image(rect), gray, COLOR_BGRA2GRAY);
+        else
+            gray = image(rect);
+        resize(gray, sample, size_, 0, 0, INTER_LINEAR);
+        vector<short> row(sample.cols);
+        char zero = 0;
+        f_.write(&zero, 1);
+        for (int y = 0; y < sample.rows; ++y)
+        {
+            const uchar* p = sample.ptr<uchar>(y);
+            for (int x = 0; x < sample.cols; ++x)
+                row[x] = p[x];
+            f_.write((const char*)&row[0], row.size() * sizeof(short));
+        }
+        ++count_;
+    }
+    // the count in the header, so the file is complete after every flush.
+    void flush()
+    {
+        if (!is_open())
+            return;
+        streampos end = f_.tellp();
+        f_.seekp(0, ios_base::beg);
+        f_.write((const char*)&count_, sizeof(count_));
+        f_.seekp(end);
+        f_.flush();
     }
 protected:
-    virtual Mat _filter(Mat& image)
+    void write_header()
     {
-        Mat res = image;
-        vector<Vec2f> lines;
-        HoughLines(image, lines, rho_*.1, theta_*(CV_PI/180), threshval_);
-        Mat show = graph_->origin().clone();
-        for( size_t i = 0; i < lines.size(); i++ )
-        {
-            float rho = lines[i][0], theta = lines[i][1];
-            Point pt1, pt2;
-            double a = cos(theta), b = sin(theta);
-            double x0 = a*rho, y0 = b*rho;
-            pt1.x = cvRound(x0 + 1000*(-b));
-            pt1.y = cvRound(y0 + 1000*(a));
-            pt2.x = cvRound(x0 - 1000*(-b));
-            pt2.y = cvRound(y0 - 1000*(a));
-            line(show, pt1, pt2, Scalar(0,0,255), 2, LINE_AA);
-        }
-        imshow(name_, show);
-        return res;
+        int header[2] = { 0, size_.area() };
+        short range[2] = { 0, 0 };
+        f_.write((const char*)header, sizeof(header));
+        f_.write((const char*)range, sizeof(range));
     }
-    int rho_;
-    int theta_;
-    int threshval_;
+    fstream f_;
+    Size size_;
+    int count_;
 };
 
-class HoughLinesP_filter : public itf_filter
+// writes samples of cut/cut2 on its own thread, so a click on a big
+// frame does not wait for the encoder. info files (pos.txt, neg.txt)
+// stay open and are flushed once per batch of samples.
+class sample_writer
 {
 public:
-    HoughLinesP_filter(const string& name) : itf_filter(name)
+    struct job
     {
-        rho_ = 10;
-        theta_ = 1;
-        threshval_ = 50;
-        createTrackbar("rho*.1", name_, &rho_, 100, itf_filter::update_, this);
-        createTrackbar("theta angle", name_, &theta_, 180, itf_filter::update_, this);
-        createTrackbar("threshval", name_, &threshval_, 1000, itf_filter::update_, this);
-        setTrackbarMin("theta angle", name_, 1);
+        string path;
+        Mat image;
+        // areas set to black before writing, for negatives.
+        vector<Rect> blank;
+        string info;
+        string line;
+        // areas appended to a .vec instead of writing path.
+        shared_ptr<vec_file> vec;
+        vector<Rect> crops;
+    };
+    static sample_writer& instance()
+    {
+        static sample_writer writer;
+        return writer;
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    void write(const job& j)
     {
-        Mat res = image;
-        vector<Vec4i> lines;
-        HoughLinesP(image, lines, rho_*.1, theta_*(CV_PI/180), threshval_, 50, 10);
-        Mat show = graph_->origin().clone();
-        for( size_t i = 0; i < lines.size(); i++ )
         {
-            Vec4i l = lines[i];
-            line(show, Point(l[0], l[1]), Point(l[2], l[3]), Scalar(0,0,255), 2, LINE_AA);
+            lock_guard<mutex> lock(mutex_);
+            if (!worker_.joinable())
+                worker_ = thread(&sample_writer::run, this);
+            jobs_.push_back(j);
+            ++pending_;
         }
-        imshow(name_, show);
-        return res;
+        cond_.notify_all();
     }
-    int rho_;
-    int theta_;
-    int threshval_;
-};
-
-class HoughCircles_filter : public itf_filter
-{
-public:
-    HoughCircles_filter(const string& name) : itf_filter(name)
+    void write(const string& path, const Mat& image)
     {
-        dist_ = 16;
-        radius1_ = 1;
-        radius2_ = 30;
-        createTrackbar("distance", name_, &dist_, 32, itf_filter::update_, this);
-        createTrackbar("radius (bound 1)", name_, &radius1_, 100, itf_filter::update_, this);
-        createTrackbar("radius (bound 2)", name_, &radius2_, 100, itf_filter::update_, this);
-        setTrackbarMin("radius (bound 1)", name_, 1);
-        setTrackbarMin("radius (bound 2)", name_, 1);
+        job j;
+        j.path = path;
+        j.image = image;
+        write(j);
+    }
+    // returns once everything queued so far is on disk.
+    void flush()
+    {
+        unique_lock<mutex> lock(mutex_);
+        done_.wait(lock, [this](){ return pending_ == 0; });
+    }
+    ~sample_writer()
+    {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        if (worker_.joinable())
+            worker_.join();
+        for (map<string, ofstream*>::iterator it = infos_.begin(); it != infos_.end(); ++it)
+            delete it->second;
     }
 protected:
-    virtual Mat _filter(Mat& image)
+    sample_writer() : pending_(0), stop_(false) {}
+    void run()
     {
-        Mat res = image;
-        vector<Vec3f> circles;
-        HoughCircles(image, circles, HOUGH_GRADIENT, 1, image.rows/max(dist_, 1), 100, 30,
-                     min(radius1_, radius2_), max(radius1_, radius2_));
-        Mat show = graph_->origin().clone();
-        for( size_t i = 0; i < circles.size(); i++ )
-        {
-            Vec3i c = circles[i];
-            Point center = Point(c[0], c[1]);
-            // circle center
-            circle(show, center, 1, Scalar(0,100,100), 1, LINE_AA);
-            // circle outline
-            int radius = c[2];
-            circle(show, center, radius, Scalar(255,0,255), 1, LINE_AA);
-        }
-        imshow(name_, show);
-        return res;
+        for (;;)
+        {
+            vector<job> batch;
+            {
+                unique_lock<mutex> lock(mutex_);
+                cond_.wait(lock, [this](){ return stop_ || !jobs_.empty(); });
+                if (jobs_.empty())
+                    return;
+                batch.swap(jobs_);
+            }
+            vector<ofstream*> touched;
+            vector<vec_file*> vecs;
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                job& j = batch[i];
+                if (j.vec)
+                {
+                    for (size_t k = 0; k < j.crops.size(); ++k)
+                        j.vec->append(j.image, j.crops[k]);
+                    vecs.push_back(j.vec.get());
+                }
+                else if (!j.image.empty())
+                {
+                    Mat image = j.image;
+                    if (!j.blank.empty())
+                    {
+                        image = j.image.clone();
+                        for (size_t k = 0; k < j.blank.size(); ++k)
+                            image(j.blank[k] & Rect(0, 0, image.cols, image.rows)).setTo(Scalar::all(0));
+                    }
+                    try
+                    {
+                        imwrite(j.path, image);
+                    }
+                    catch (const cv::Exception& e)
+                    {
+                        cout << j.path << ": " << e.what() << endl;
+                    }
+                }
+                if (!j.info.empty())
+                {
+                    ofstream*& fout = infos_[j.info];
+                    if (!fout)
+                        fout = new ofstream(j.info.c_str(), ios_base::out|ios_base::app);
+                    *fout << j.line;
+                    touched.push_back(fout);
+                }
+            }
+            for (size_t i = 0; i < touched.size(); ++i)
+                touched[i]->flush();
+            for (size_t i = 0; i < vecs.size(); ++i)
+                vecs[i]->flush();
+            {
+                lock_guard<mutex> lock(mutex_);
+                pending_ -= batch.size();
+            }
+            done_.notify_all();
+        }
     }
-    int dist_;
-    int radius1_;
-    int radius2_;
+    vector<job> jobs_;
+    size_t pending_;
+    bool stop_;
+    map<string, ofstream*> infos_;
+    mutex mutex_;
+    condition_variable cond_;
+    condition_variable done_;
+    thread worker_;
 };
 
-class morphology_filter : public itf_filter
+// stage outputs of many frames in one append-only file. a 64 byte file
+// header, then per Mat a 64 byte record header and its continuous data,
+// padded to 64 bytes. the record headers are the index, walked on open
+// up to the first one without its magic: a killed run leaves the grown
+// tail of the file zero filled, or a record whose header was not yet
+// written, the data goes in first.
+// recording grows the file and writes through a shared mapping; replay
+// maps it copy-on-write and hands out Mats pointing into the mapping.
+// without mmap (_WIN32) it is written with stdio and read into memory.
+class frame_store
 {
 public:
-    morphology_filter(const string& name) : itf_filter(name)
+    struct record
     {
-        method_ = 0;
-        threshval_ = 0;
-        shape_ = 0;
-        kernel_ = 1;
-        createTrackbar("morphology", name_, &threshval_, 20, itf_filter::update_, this);
-        setTrackbarMin("morphology", name_, -10);
-        setTrackbarMax("morphology", name_, 10);
-        //setTrackbarPos("morphology", name_, 0);
-        createTrackbar("method:\n0-open\n1-close\n2-erode\n3-dilate\n4-gradient\n5-tophat\n6-blackhat", name_, &method_, 6, itf_filter::update_, this);
-        createTrackbar("rect/ellipse/cross", name_, &shape_, 2, itf_filter::update_, this);
-        createTrackbar("kernel(OFF/ON)", name_, &kernel_, 1, itf_filter::update_, this);
+        int64 frame;
+        int32_t stage;
+        int32_t rows;
+        int32_t cols;
+        int32_t type;
+        int64 bytes;
+        char magic[8];
+        char pad[24];
+    };
+    frame_store(const string& path, bool write)
+        : write_(write), base_(0), size_(0), capacity_(0), fd_(-1), file_(0)
+    {
+        if (write)
+            create(path);
+        else
+            open(path);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    ~frame_store()
     {
-        Mat res;
-        int n = threshval_;
-        int an = abs(n);
-        Mat element;
-        if (kernel_)
-        switch (shape_)
+        close();
+    }
+    bool is_open() const { return base_ != 0 || file_ != 0; }
+    // the first output of a (frame, stage) is kept, it is not written again.
+    bool append(int64 frame, int stage, const Mat& m)
+    {
+        if (!write_ || m.empty() || m.dims > 2)
+            return false;
         {
-        case 0:
-            element = getStructuringElement(MORPH_RECT, Size(an*2+1, an*2+1), Point(an, an) );
-            break;
-        case 1:
-            element = getStructuringElement(MORPH_ELLIPSE, Size(an*2+1, an*2+1), Point(an, an) );
-            break;
-        case 2:
-            element = getStructuringElement(MORPH_CROSS, Size(an*2+1, an*2+1), Point(an, an) );
-            break;
+            lock_guard<mutex> lock(mutex_);
+            if (index_.count(make_pair(frame, stage)))
+                return true;
         }
-        switch (method_)
-        {
-        case 0:
-            morphologyEx(image, res, MORPH_OPEN, element);
-            break;
-        case 1:
-            morphologyEx(image, res, MORPH_CLOSE, element);
-            break;
-        case 2:
-            erode(image, res, element);
-            break;
-        case 3:
-            dilate(image, res, element);
-            break;
-        case 4:
-            morphologyEx(image, res, MORPH_GRADIENT, element);
-            break;
-        case 5:
-            morphologyEx(image, res, MORPH_TOPHAT, element);
-            break;
-        case 6:
-            morphologyEx(image, res, MORPH_BLACKHAT, element);
-            break;
-        //case 7: // src.type() == CV_8UC1
-         //   morphologyEx(image, res, MORPH_HITMISS, element);
-          //  break;
-        }
-        imshow(name_, res);
-        return res;
+        Mat c = m.isContinuous() ? m : m.clone();
+        record r;
+        memset(&r, 0, sizeof(r));
+        memcpy(r.magic, record_magic(), sizeof(r.magic));
+        r.frame = frame;
+        r.stage = stage;
+        r.rows = c.rows;
+        r.cols = c.cols;
+        r.type = c.type();
+        r.bytes = (int64)(c.total() * c.elemSize());
+        lock_guard<mutex> lock(mutex_);
+        if (index_.count(make_pair(frame, stage)))
+            return true;
+        size_t at = size_;
+        size_t end = at + sizeof(record) + align(r.bytes);
+        if (!reserve(end))
+            return false;
+#ifndef _WIN32
+        put(at + sizeof(record), c.data, (size_t)r.bytes);
+        put(at, &r, sizeof(r));
+#else
+        put(at, &r, sizeof(r));
+        put(at + sizeof(record), c.data, (size_t)r.bytes);
+#endif
+        size_ = end;
+        index_[make_pair(frame, stage)] = at;
+        return true;
     }
-    int threshval_;
-    int method_;
-    int shape_;
-    int kernel_;
-
-};
-
-class medianBlur_filter : public itf_filter
-{
-public:
-    medianBlur_filter(const string& name) : itf_filter(name)
+    // a header on the mapped data, empty if not recorded.
+    Mat get(int64 frame, int stage) const
     {
-        ksize_ = 1;
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
+        if (write_)
+            return Mat();
+        map<pair<int64, int>, size_t>::const_iterator it = index_.find(make_pair(frame, stage));
+        if (it == index_.end())
+            return Mat();
+        const record* r = (const record*)(base_ + it->second);
+        return Mat(r->rows, r->cols, r->type, base_ + it->second + sizeof(record));
+    }
+    // the frames stage was recorded for, in order.
+    vector<int64> frames(int stage) const
+    {
+        vector<int64> v;
+        for (map<pair<int64, int>, size_t>::const_iterator it = index_.begin(); it != index_.end(); ++it)
+        {
+            if (it->first.second == stage)
+                v.push_back(it->first.first);
+        }
+        sort(v.begin(), v.end());
+        return v;
     }
 protected:
-    virtual Mat _filter(Mat& image)
+    static const size_t header_size = 64;
+    static const char* file_magic() { return "CVTSTORE2"; }
+    static const char* record_magic() { return "CVTREC1"; }
+    static size_t align(int64 n) { return (size_t)((n + 63) & ~(int64)63); }
+    void create(const string& path)
     {
-        Mat res;
-        medianBlur(image, res, ksize_|1);
-        imshow(name_, res);
-        return res;
+        char header[header_size] = { 0 };
+        strcpy(header, file_magic());
+#ifndef _WIN32
+        fd_ = ::open(path.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+        if (fd_ < 0)
+            return;
+        if (!reserve(header_size))
+            return;
+        put(0, header, header_size);
+#else
+        file_ = fopen(path.c_str(), "wb");
+        if (!file_)
+            return;
+        fwrite(header, 1, header_size, file_);
+#endif
+        size_ = header_size;
     }
-    int ksize_;
-};
-
-class GaussianBlur_filter : public itf_filter
-{
-public:
-    GaussianBlur_filter(const string& name) : itf_filter(name)
+    void open(const string& path)
     {
-        ksize_ = 1;
-        sigma_ = 1;
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
-        createTrackbar("sigma*.5", name_, &sigma_, 15, itf_filter::update_, this);
+        size_t n = 0;
+#ifndef _WIN32
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) != 0 || (size_t)st.st_size < header_size)
+            return;
+        n = (size_t)st.st_size;
+        void* p = mmap(0, n, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd_, 0);
+        if (p == MAP_FAILED)
+            return;
+        base_ = (uchar*)p;
+        capacity_ = n;
+#else
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f)
+            return;
+        fseek(f, 0, SEEK_END);
+        n = (size_t)ftell(f);
+        fseek(f, 0, SEEK_SET);
+        buffer_.resize(n);
+        if (n < header_size || fread(&buffer_[0], 1, n, f) != n)
+            n = 0;
+        fclose(f);
+        if (n == 0)
+            return;
+        base_ = &buffer_[0];
+#endif
+        if (memcmp(base_, file_magic(), 9) != 0)
+        {
+            cout << path << " is not a frame store" << endl;
+            return;
+        }
+        // a record cut short by a crash ends the index.
+        size_t at = header_size;
+        while (at + sizeof(record) <= n)
+        {
+            const record* r = (const record*)(base_ + at);
+            if (memcmp(r->magic, record_magic(), sizeof(r->magic)) != 0 ||
+                r->rows <= 0 || r->cols <= 0 ||
+                r->bytes != (int64)r->rows * r->cols * CV_ELEM_SIZE(r->type))
+                break;
+            size_t end = at + sizeof(record) + align(r->bytes);
+            if (end > n)
+                break;
+            index_[make_pair(r->frame, (int)r->stage)] = at;
+            at = end;
+        }
+        size_ = at;
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    void close()
     {
-        Mat res;
-        GaussianBlur(image, res, Size(ksize_|1, ksize_|1), sigma_*.5, sigma_*.5);
-        imshow(name_, res);
-        return res;
+#ifndef _WIN32
+        if (base_)
+            munmap(base_, capacity_);
+        if (fd_ >= 0)
+        {
+            if (write_)
+            {
+                if (ftruncate(fd_, size_) != 0)
+                    cout << "can not trim the frame store" << endl;
+            }
+            ::close(fd_);
+        }
+#else
+        if (file_)
+            fclose(file_);
+#endif
+        base_ = 0;
+        file_ = 0;
+        fd_ = -1;
     }
-    int ksize_;
-    int sigma_;
-};
-
-class bilateral_filter : public itf_filter
-{
-public:
-    bilateral_filter(const string& name) : itf_filter(name)
+    // grows the file and its mapping to at least n bytes.
+    bool reserve(size_t n)
     {
-        d_ = 5;
-        sigmaC_ = 100;
-        sigmaS_ = 100;
-        createTrackbar("d", name_, &d_, 11, itf_filter::update_, this);
-        createTrackbar("sigmaColor", name_, &sigmaC_, 300, itf_filter::update_, this);
-        createTrackbar("sigmaSpace", name_, &sigmaS_, 300, itf_filter::update_, this);
+#ifndef _WIN32
+        if (n <= capacity_)
+            return true;
+        size_t cap = max(max(n, capacity_ * 2), (size_t)64 << 20);
+        if (ftruncate(fd_, cap) != 0)
+            return false;
+        if (base_)
+            munmap(base_, capacity_);
+        void* p = mmap(0, cap, PROT_READ|PROT_WRITE, MAP_SHARED, fd_, 0);
+        base_ = p == MAP_FAILED ? 0 : (uchar*)p;
+        capacity_ = base_ ? cap : 0;
+        return base_ != 0;
+#else
+        (void)n;
+        return file_ != 0;
+#endif
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    void put(size_t at, const void* p, size_t n)
     {
-        Mat res;
-        bilateralFilter(image, res, d_, sigmaC_, sigmaS_);
-        imshow(name_, res);
-        return res;
+#ifndef _WIN32
+        memcpy(base_ + at, p, n);
+#else
+        (void)at;
+        static const char zeros[64] = { 0 };
+        fwrite(p, 1, n, file_);
+        // records are padded to 64 bytes, the header already is.
+        if (n != sizeof(record))
+            fwrite(zeros, 1, align(n) - n, file_);
+#endif
     }
-    int d_;
-    int sigmaC_;
-    int sigmaS_;
+    bool write_;
+    uchar* base_;
+    size_t size_;
+    size_t capacity_;
+    int fd_;
+    FILE* file_;
+    vector<uchar> buffer_;
+    map<pair<int64, int>, size_t> index_;
+    mutex mutex_;
 };
 
-class box_filter : public itf_filter
+// encodes frames to a video file on its own thread, so encoding overlaps
+// filtering. push() copies the frame into one of capacity preallocated
+// slots, filters may overwrite their output once it returns; with every
+// slot queued the frame is dropped and counted instead of waiting.
+// the writer opens on the first frame, later frames are resized to it,
+// gray and non 8 bit ones converted to 8 bit BGR.
+class video_sink
 {
 public:
-    box_filter(const string& name) : itf_filter(name)
+    video_sink(const string& path, double fps, size_t capacity = 16)
+        : path_(path), fps_(fps > 0 ? fps : 25.), slots_(max(capacity, (size_t)1)),
+          written_(0), dropped_(0), stop_(false), failed_(false)
     {
-        ddepth_ = 0;
-        ksize_ = 3;
-        createTrackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", name_, &ddepth_, 7, itf_filter::update_, this);
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
+        free_.resize(slots_);
+        for (size_t i = 0; i < slots_; ++i)
+            free_[i] = i;
+        buffers_.resize(slots_);
+        worker_ = thread(&video_sink::run, this);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    ~video_sink() { close(); }
+    // false if the frame was dropped.
+    bool push(const Mat& image)
     {
-        Mat res;
-        boxFilter(image, res, ddepth_-1, Size(ksize_|1, ksize_|1));
-        imshow(name_, res);
-        return res;
+        if (image.empty())
+            return false;
+        size_t slot;
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (free_.empty() || failed_ || stop_)
+            {
+                ++dropped_;
+                return false;
+            }
+            slot = free_.back();
+            free_.pop_back();
+        }
+        // the slot is neither free nor queued, it is ours until queued.
+        image.copyTo(buffers_[slot]);
+        {
+            lock_guard<mutex> lock(mutex_);
+            queue_.push_back(slot);
+        }
+        cond_.notify_one();
+        return true;
     }
-    int ddepth_;
-    int ksize_;
-};
-
-class sqrBox_filter : public itf_filter
-{
-public:
-    sqrBox_filter(const string& name) : itf_filter(name)
+    // encodes what is queued, then closes the file.
+    void close()
     {
-        ddepth_ = 0;
-        ksize_ = 3;
-        createTrackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", name_, &ddepth_, 7, itf_filter::update_, this);
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (stop_)
+                return;
+            stop_ = true;
+        }
+        cond_.notify_one();
+        if (worker_.joinable())
+            worker_.join();
     }
+    int64 written() const { lock_guard<mutex> lock(mutex_); return written_; }
+    int64 dropped() const { lock_guard<mutex> lock(mutex_); return dropped_; }
+    bool failed() const { lock_guard<mutex> lock(mutex_); return failed_; }
+    const string& path() const { return path_; }
 protected:
-    virtual Mat _filter(Mat& image)
+    static int fourcc_of(const string& path)
     {
-        Mat res;
-        sqrBoxFilter(image, res, ddepth_-1, Size(ksize_|1, ksize_|1));
-        imshow(name_, res);
-        return res;
+        string ext = path.substr(path.find_last_of('.') + 1);
+        transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == "avi")
+            return VideoWriter::fourcc('M', 'J', 'P', 'G');
+        if (ext == "mkv")
+            return VideoWriter::fourcc('X', '2', '6', '4');
+        return VideoWriter::fourcc('m', 'p', '4', 'v');
     }
-    int ddepth_;
-    int ksize_;
-};
-
-class blur_filter : public itf_filter
-{
-public:
-    blur_filter(const string& name) : itf_filter(name)
+    void encode(const Mat& image)
     {
-        ksize_ = 3;
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
+        Mat bgr = image;
+        if (bgr.depth() != CV_8U)
+            normalize(bgr, bgr, 0, 255, NORM_MINMAX, CV_8U);
+        if (bgr.channels() == 1)
+            cvtColor(bgr, bgr, COLOR_GRAY2BGR);
+        else if (bgr.channels() == 4)
+            cvtColor(bgr, bgr, COLOR_BGRA2BGR);
+        if (!writer_.isOpened())
+        {
+            size_ = bgr.size();
+            if (!writer_.open(path_, fourcc_of(path_), fps_, size_, true))
+            {
+                lock_guard<mutex> lock(mutex_);
+                failed_ = true;
+                return;
+            }
+        }
+        if (bgr.size() != size_)
+            resize(bgr, bgr, size_);
+        writer_.write(bgr);
+        lock_guard<mutex> lock(mutex_);
+        ++written_;
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    void run()
     {
-        Mat res;
-        blur(image, res, Size(ksize_|1, ksize_|1));
-        imshow(name_, res);
-        return res;
+        for (;;)
+        {
+            size_t slot;
+            {
+                unique_lock<mutex> lock(mutex_);
+                cond_.wait(lock, [this](){ return stop_ || !queue_.empty(); });
+                if (queue_.empty())
+                    break;
+                slot = queue_.front();
+                queue_.pop_front();
+            }
+            if (!failed())
+                encode(buffers_[slot]);
+            lock_guard<mutex> lock(mutex_);
+            free_.push_back(slot);
+        }
+        writer_.release();
     }
-    int ksize_;
+    string path_;
+    double fps_;
+    size_t slots_;
+    Size size_;
+    VideoWriter writer_;
+    vector<Mat> buffers_;
+    vector<size_t> free_;
+    deque<size_t> queue_;
+    int64 written_;
+    int64 dropped_;
+    bool stop_;
+    bool failed_;
+    mutable mutex mutex_;
+    condition_variable cond_;
+    thread worker_;
 };
 
-class filter2D_filter;
-class sepFilter2D_filter;
+inline string type_name(int type)
+{
+    static const char* depths[] = { "8U", "8S", "16U", "16S", "32S", "32F", "64F", "16F" };
+    if (type < 0)
+        return "-";
+    ostringstream os;
+    os << depths[CV_MAT_DEPTH(type)] << "C" << CV_MAT_CN(type);
+    return os.str();
+}
 
-class Sobel_filter : public itf_filter
+class filter_graph;
+class itf_filter
 {
 public:
-    Sobel_filter(const string& name) : itf_filter(name)
+    itf_filter(const string& name) : num_(++snum_), color_(0), graph_(0), visible_(true),
+          flip_(0), reuse_(0), buffered_(false), display_set_(false),
+          displayed_(false), pending_scale_(1.), redo_(false)
     {
-        dx_ = dy_ = 1;
-        ddepth_ = 0;
-        ksize_ = 3;
-        createTrackbar("dx", name_, &dx_, 10, itf_filter::update_, this);
-        setTrackbarMax("dx", name_, max(((ksize_|1) - 1), 1));
-        createTrackbar("dy", name_, &dy_, 10, itf_filter::update_, this);
-        setTrackbarMax("dy", name_, max(((ksize_|1) - 1), 1));
-        createTrackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", name_, &ddepth_, 7, itf_filter::update_, this);
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
+        ostringstream os;
+        os << num_ << ": " << name << " -=>@github.com/bbqz007";
+        name_ = os.str();
+        if (!headless())
+            namedWindow(name_);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+	itf_filter(const string& name, const string& comment) : num_(++snum_), color_(0), graph_(0), visible_(true),
+		  flip_(0), reuse_(0), buffered_(false), display_set_(false),
+		  displayed_(false), pending_scale_(1.), redo_(false)
+	{
+		ostringstream os;
+		os << num_ << ": " << name << comment << " -=>@github.com/bbqz007";
+		name_ = os.str();
+		if (!headless())
+			namedWindow(name_);
+	}
+    virtual ~itf_filter()
+    {
+        if (!headless())
+            destroyWindow(name_);
+    }
+    Mat filter(Mat& image)
     {
+        int64 t0 = getTickCount();
+        if (!display_set_)
+            begin_display_();
+        display_set_ = false;
+        shown_ = Mat();
+        displayed_ = false;
+        buffered_ = false;
         Mat res;
-        setTrackbarMax("dx", name_, max(((ksize_|1) - 1), 1));
-        setTrackbarMax("dy", name_, max(((ksize_|1) - 1), 1));
-        if (dx_ == 0)
-            setTrackbarMin("dy", name_, 1);
-        if (dy_ == 0)
-            setTrackbarMin("dx", name_, 1);
-        if (dx_ && dy_)
+        if (replace_)
         {
-            setTrackbarMin("dy", name_, 0);
-            setTrackbarMin("dx", name_, 0);
+            // the stages fused into this one, see filter_graph::fuse_.
+            Mat& out = output_();
+            replace_(image, out);
+            replace_ = nullptr;
+            res = out;
+            display(res);
         }
-        Sobel(image, res, ddepth_-1, dx_, dy_, ksize_|1);
-        imshow(name_, res);
+        else
+            res = _filter(image);
+        // a hidden window whose drawing was skipped, redraw_ runs it again.
+        if (!displayed_)
+            pend_(nullptr, true);
+        stats_.latency.add((int64)((getTickCount() - t0) * (1e9 / getTickFrequency())));
+        if (buffered_ && !res.empty())
+        {
+            if (res.data == reuse_)
+                ++stats_.reused;
+            else
+                ++stats_.allocated;
+        }
+        stats_.size = res.size();
+        stats_.type = res.empty() ? -1 : res.type();
         return res;
     }
-    int dx_;
-    int dy_;
-    int ddepth_;
-    int ksize_;
-};
-
-class Scharr_filter : public itf_filter
-{
-public:
-    Scharr_filter(const string& name) : itf_filter(name)
+    const stage_stats& stats() const { return stats_; }
+	void bringTop()
+	{
+		if (!headless())
+			setWindowProperty(name_, 5, 0);
+	}
+    // a trackbar value, in the order the filter created them.
+    struct param
     {
-        dx_ = dy_ = 0;
-        ddepth_ = 0;
-        createTrackbar("dx(0,1)", name_, &dx_, 1, itf_filter::update_, this);
-        //createTrackbar("dy*.01", name_, &dy_, 1, itf_filter::update_, this);
-        createTrackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", name_, &ddepth_, 7, itf_filter::update_, this);
+        string label;
+        string window;
+        int* value;
+    };
+    const vector<param>& params() const { return trackbars_; }
+    // no windows, no trackbars, no imshow; see --headless of cvtool.
+    static bool& headless()
+    {
+        static bool headless = false;
+        return headless;
     }
 protected:
-    virtual Mat _filter(Mat& image)
+    const Scalar& next_color(bool reset = false)
     {
-        Mat res;
-        Scharr(image, res, ddepth_-1, dx_, 1 - dx_);
-        imshow(name_, res);
-        return res;
+        static const Scalar colors[] =
+        {
+            Scalar(0,0,0),
+            Scalar(255,0,0),
+            Scalar(255,128,0),
+            Scalar(255,255,0),
+            Scalar(0,255,0),
+            Scalar(0,128,255),
+            Scalar(0,255,255),
+            Scalar(0,0,255),
+            Scalar(255,0,255)
+        };
+        static const int limits = sizeof(colors) / sizeof(Scalar);
+        if (reset)
+            color_ = 0;
+        return colors[++color_%limits];
     }
-    int dx_;
-    int dy_;
-    int ddepth_;
+    static void update_(int pos, void* userdata);
+    // origin, if not empty, is what the stages after draw on from now.
+    void update_next_(Mat image, Mat origin = Mat());
+    // for state shared with highgui callbacks, which run on the GUI
+    // thread: the graph's lock, none without a graph. not around
+    // display() or update_next_(), they take it themselves.
+    unique_lock<mutex> lock_();
+    virtual Mat _filter(Mat& image) = 0;
+    void add_trackbar(const string& label, int* value, int count)
+    {
+        add_trackbar(label, name_, value, count, itf_filter::update_, this);
+    }
+    void add_trackbar(const string& label, const string& window, int* value, int count,
+                      TrackbarCallback callback, void* userdata)
+    {
+        param p = { label, window, value };
+        trackbars_.push_back(p);
+        if (!headless())
+            createTrackbar(label, window, value, count, callback, userdata);
+    }
+    // below 1 while filter_graph evaluates a downscaled proxy, size
+    // dependent parameters go through scaled() to keep the preview alike.
+    double scale() const;
+    int scaled(int v) const { return cvRound(v * scale()); }
+    int scaled_ksize(int ksize) const { return max(1, scaled(ksize|1))|1; }
+    // false for filters which can not run on a proxy, e.g. they take
+    // mouse coordinates or feed results back into their trackbars.
+    virtual bool proxy_ok_() const { return true; }
+    // point ops on 8 bit data: for input of type, the 1x256 table every
+    // value goes through, one channel applied to each channel, or three
+    // for one channel input made BGR. head if the table applies to the
+    // one channel lut_head_ makes of the input first. false if the
+    // filter is not one, see filter_graph::fuse_points_.
+    virtual bool lut_(int type, Mat& table, bool& head) { (void)type; (void)table; (void)head; return false; }
+    virtual void lut_head_(const Mat& image, Mat& res) { image.copyTo(res); }
+    // the table of a point op, from its own operation on 0..255.
+    static Mat ramp_()
+    {
+        Mat ramp(1, 256, CV_8U);
+        for (int v = 0; v < 256; ++v)
+            ramp.at<uchar>(v) = (uchar)v;
+        return ramp;
+    }
+    // highgui calls of _filter, on the GUI thread; see filter_graph::async.
+    void trackbar_min(const string& label, int v);
+    void trackbar_max(const string& label, int v);
+    void trackbar_pos(const string& label, int v);
+    void display(const Mat& image);
+    // for drawings over the result, draw runs only when the window is
+    // shown, now or by filter_graph::redraw_ later.
+    void draw_(function<Mat()> draw);
+    void pend_(function<Mat()> draw, bool redo = false);
+    void show_(const Mat& image, double s);
+    // where _filter writes its output. the two buffers are used in turn,
+    // so the last output stays valid for the stages downstream, and one
+    // is written again only when nothing else holds it any more; then
+    // OpenCV's create() keeps the memory as long as size and type match.
+    Mat& output_()
+    {
+        flip_ ^= 1;
+        Mat& m = outbuf_[flip_];
+        if (m.u && m.u->refcount > 1)
+            m.release();
+        reuse_ = m.data;
+        buffered_ = true;
+        return m;
+    }
+    // whether display() of this evaluation reaches the window, filters
+    // skip their clone and drawing work when it does not.
+    bool visible() const { return visible_ && !headless(); }
+    void begin_display_();
+    string name_;
+    const int num_;
+    static atomic<int> snum_;
+    int color_;
+    filter_graph* graph_;
+    vector<param> trackbars_;
+    stage_stats stats_;
+    bool visible_;
+    // visible_ was decided for the next filter() call already.
+    bool display_set_;
+    // what display() showed last, for frame_cache.
+    Mat shown_;
+    bool displayed_;
+    // under graph_->mutex_: the drawing display() skipped last while the
+    // window was hidden and its proxy scale, or redo_ if there is none.
+    function<Mat()> pending_;
+    double pending_scale_;
+    bool redo_;
+    // set by filter_graph for one call, runs instead of _filter.
+    function<void(const Mat&, Mat&)> replace_;
+    Mat outbuf_[2];
+    int flip_;
+    const uchar* reuse_;
+    bool buffered_;
+    friend class filter_graph;
 };
 
-class Laplacian_filter : public itf_filter
+typedef shared_ptr<itf_filter> sptr_filter;
+
+class filter_graph
 {
 public:
-    Laplacian_filter(const string& name) : itf_filter(name)
+    filter_graph()
+        : dirty_(0), seed_i_(-1), stop_(false),
+          pdirty_(0), pscale_(1.), proxy_side_(0), idle_ms_(300),
+          display_(display_all), display_fps_(10.), top_(-1), refresh_(false),
+          gen_(0), index_(-1), seed_clear_(false), fusion_(true)
     {
-        ddepth_ = 0;
-        ksize_ = 3;
-        delta_ = 0;
-        createTrackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", name_, &ddepth_, 7, itf_filter::update_, this);
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
-        createTrackbar("delta", name_, &delta_, 11, itf_filter::update_, this);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    ~filter_graph()
     {
-        Mat res;
-        Laplacian(image, res, (ddepth_)?ddepth_*8:-1, ksize_|1, 1, delta_);
-        imshow(name_, res);
-        return res;
+        async(false);
     }
-    int ddepth_;
-    int ksize_;
-    int delta_;
-};
-
-class cornerMinEigenVal_filter : public itf_filter
-{
-public:
-    cornerMinEigenVal_filter(const string& name) : itf_filter(name)
+    // index is the frame number for the cache, -1 if not cached.
+    Mat filter(Mat& image, int64 index = -1)
     {
-        blocksize_ = 3;
-        ksize_ = 7;
-        createTrackbar("block size", name_, &blocksize_, 7, itf_filter::update_, this);
-        setTrackbarMin("block size", name_, 1);
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
+        if (recorder_ && index >= 0)
+            recorder_->append(index, -1, image);
+        if (worker_.joinable())
+        {
+            lock_guard<mutex> lock(mutex_);
+            tmp_ = image;
+            index_ = index;
+            invalidate(0);
+            pdirty_ = 0;
+            ptmp_ = Mat();
+            changed_ = chrono::steady_clock::time_point();
+            cond_.notify_one();
+            return Mat();
+        }
+        tmp_ = image;
+        index_ = index;
+        invalidate(0);
+        return filter();
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    // stage outputs of recent frames; revisiting a frame whose trackbars
+    // did not move since shows them instead of running the filters.
+    void cache(shared_ptr<frame_cache> c)
     {
-        Mat res;
-        Mat src;
-        if (!(image.type() == CV_8UC1 || image.type() == CV_32FC1))
+        lock_guard<mutex> lock(mutex_);
+        cache_ = c;
+    }
+    shared_ptr<frame_cache> cache() const { return cache_; }
+    // writes the input and every stage output of numbered frames to a
+    // frame_store. set it before async(true).
+    void record(shared_ptr<frame_store> store) { recorder_ = store; }
+    // image as the output of stage, only the stages after it run, for a
+    // frame_store replay. origin is what drawing filters draw on, the
+    // decoded frame; stages up to stage run from it if their trackbars move.
+    Mat filter_from(size_t stage, Mat image, Mat origin, int64 index = -1)
+    {
+        if (stage >= filters_.size())
+            return image;
+        if (worker_.joinable())
         {
-            cvtColor(image, src, CV_BGR2GRAY);
+            lock_guard<mutex> lock(mutex_);
+            tmp_ = origin.empty() ? image : origin;
+            index_ = index;
+            seed_i_ = (int)stage;
+            seed_ = image;
+            seed_clear_ = true;
+            dirty_ = stage + 1;
+            pdirty_ = 0;
+            ptmp_ = Mat();
+            changed_ = chrono::steady_clock::time_point();
+            cond_.notify_one();
+            return Mat();
         }
-        else
+        tmp_ = origin.empty() ? image : origin;
+        index_ = index;
+        for (size_t i = 0; i < stage; ++i)
         {
-            src = image;
+            outs_[i] = Mat();
+            ran_[i] = 0;
         }
-        cornerMinEigenVal(src, res, blocksize_, ksize_|1);
-        imshow(name_, res);
-        return res;
+        outs_[stage] = image;
+        ran_[stage] = 1;
+        dirty_ = stage + 1;
+        return filter();
     }
-    int blocksize_;
-    int ksize_;
-};
-
-class cornerHarris_filter : public itf_filter
-{
-public:
-    cornerHarris_filter(const string& name) : itf_filter(name)
+    // evaluate on a worker thread. trackbar changes only move the dirty
+    // watermark, so a burst of them is coalesced into one evaluation,
+    // and an evaluation whose upstream became dirty stops at the next
+    // stage. imshow and trackbar updates of filters are staged, the
+    // newest finished ones per window are shown by present().
+    void async(bool on);
+    bool async() const { return worker_.joinable(); }
+    // while trackbars move, evaluate on a copy of the input whose longer
+    // side is at most max_side, and at full size once they have been
+    // idle for idle_ms. needs async(true); max_side 0 turns it off.
+    void proxy(int max_side, int idle_ms = 300)
     {
-        blocksize_ = 3;
-        ksize_ = 7;
-        k_ = 11;
-        createTrackbar("block size", name_, &blocksize_, 7, itf_filter::update_, this);
-        setTrackbarMin("block size", name_, 1);
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
-        createTrackbar("k*.25", name_, &ksize_, 31, itf_filter::update_, this);
-
+        lock_guard<mutex> lock(mutex_);
+        proxy_side_ = max_side;
+        idle_ms_ = idle_ms;
+        ptmp_ = Mat();
+        pdirty_ = 0;
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    // on the GUI thread, between waitKey()s.
+    void present();
+    void open(const string& cmd);
+    // the graph spec and every trackbar value, as a cv::FileStorage file.
+    bool save(const string& path) const;
+    bool load(const string& path);
+    // per stage latency p50/p95/p99/max, calls and last output.
+    void print_stats(ostream& os) const;
+    bool dump_stats(const string& path) const;
+    void reset_stats()
     {
-        Mat res;
-        Mat src;
-        if (!(image.type() == CV_8UC1 || image.type() == CV_32FC1))
+        for (size_t i = 0; i < filters_.size(); ++i)
+            filters_[i]->stats_ = stage_stats();
+    }
+    // the filter of stage i, for its stats() and params().
+    const itf_filter& stage(size_t i) const { return *filters_[i]; }
+    // the last output of stage i, of a graph filtered synchronously.
+    // empty if it was fused into a later stage, unless it is tapped.
+    Mat output(size_t i) const { return i < outs_.size() ? outs_[i] : Mat(); }
+    // off, every stage runs its own filter and keeps its output and
+    // stats, e.g. to time filters one by one.
+    void fusion(bool on) { fusion_ = on; }
+    // output(i) is read after each filter(), stage i is not fused away.
+    void tap(size_t i)
+    {
+        if (i < taps_.size())
+            taps_[i] = 1;
+    }
+    void merge_stats(const filter_graph& other)
+    {
+        for (size_t i = 0; i < filters_.size() && i < other.filters_.size(); ++i)
         {
-            cvtColor(image, src, CV_BGR2GRAY);
+            filters_[i]->stats_.latency.merge(other.filters_[i]->stats_.latency);
+            filters_[i]->stats_.reused += other.filters_[i]->stats_.reused;
+            filters_[i]->stats_.allocated += other.filters_[i]->stats_.allocated;
+            // a replica that ran the stage reports its latest output shape.
+            if (!other.filters_[i]->stats_.size.empty())
+            {
+                filters_[i]->stats_.size = other.filters_[i]->stats_.size;
+                filters_[i]->stats_.type = other.filters_[i]->stats_.type;
+            }
         }
-        else
+    }
+    // opens the same spec as other and copies its trackbar values.
+    void replicate(const filter_graph& other)
+    {
+        open(other.cmd_);
+        for (size_t i = 0; i < filters_.size() && i < other.filters_.size(); ++i)
         {
-            src = image;
+            const vector<itf_filter::param>& to = filters_[i]->params();
+            const vector<itf_filter::param>& from = other.filters_[i]->params();
+            for (size_t j = 0; j < to.size() && j < from.size(); ++j)
+                *to[j].value = *from[j].value;
         }
-        cornerHarris(src, res, blocksize_, ksize_|1, k_*.25);
-        imshow(name_, res);
-        return res;
+        invalidate(0);
     }
-    int blocksize_;
-    int ksize_;
-    int k_;
-};
+    void push(sptr_filter& filter)
+    {
+        if (filter)
+        {
+            filter->graph_ = this;
+            filters_.push_back(filter);
+            outs_.push_back(Mat());
+            pouts_.push_back(Mat());
+            ran_.push_back(0);
+            pran_.push_back(0);
+            taps_.push_back(0);
+            version_.push_back(++gen_);
+            invalidate(filters_.size() - 1);
+        }
 
-class cornerEigenValsAndVecs_filter : public itf_filter
-{
-public:
-    cornerEigenValsAndVecs_filter(const string& name) : itf_filter(name)
+    }
+    filter_graph& apply(function<void(Mat)> f)
     {
-        blocksize_ = 3;
-        ksize_ = 7;
-        createTrackbar("block size", name_, &blocksize_, 7, itf_filter::update_, this);
-        setTrackbarMin("block size", name_, 1);
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
+        apply_ = f;
+        return *this;
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    // one frame in flight through filter_pipeline, carrying its own origin.
+    struct frame
     {
-        Mat res;
-        Mat src;
-        if (!(image.type() == CV_8UC1 || image.type() == CV_32FC1))
-        {
-            cvtColor(image, src, CV_BGR2GRAY);
-        }
+        frame() : seq(0), scale(1.) {}
+        int64 seq;
+        Mat image;
+        Mat tmp;
+        Mat retmp;
+        double scale;
+    };
+    Mat origin()
+    {
+        frame* f = flight_();
+        if (f)
+            return (f->retmp.empty())?f->tmp:f->retmp;
+        lock_guard<mutex> lock(mutex_);
+        return (retmp_.empty())?tmp_:retmp_;
+    }
+    // from a stage, for the stages after it. off the worker thread, e.g.
+    // in a mouse callback, pass it to filter_next with the seed instead:
+    // a run in flight would put its own origin back when it ends.
+    void update_origin(Mat m)
+    {
+        frame* f = flight_();
+        if (f)
+            f->retmp = m;
         else
         {
-            src = image;
+            lock_guard<mutex> lock(mutex_);
+            retmp_ = m;
         }
-        cornerEigenValsAndVecs(src, res, blocksize_, ksize_|1);
-        imshow(name_, res);
-        return res;
     }
-    int blocksize_;
-    int ksize_;
-};
-
-class preCornerDetect_filter : public itf_filter
-{
-public:
-    preCornerDetect_filter(const string& name) : itf_filter(name)
+    size_t size() const { return filters_.size(); }
+    double scale()
     {
-        ksize_ = 3;
-        threshold1_ = 0;
-        threshold2_ = 0;
-        createTrackbar("ksize|1", name_, &ksize_, 11, itf_filter::update_, this);
-        //createTrackbar("threshold*.001(bound 1)", name_, &threshold1_, 1000, itf_filter::update_, this);
-        //createTrackbar("threshold*.001(bound 2)", name_, &threshold2_, 1000, itf_filter::update_, this);
+        frame* f = flight_();
+        return f ? f->scale : 1.;
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    // runs stages [begin, end) on f, on the calling thread.
+    void filter_range(frame& f, size_t begin, size_t end)
     {
-        Mat res;
-        preCornerDetect(image, res, ksize_|1);
-        double minV, maxV;
-        minMaxLoc(res, &minV, &maxV);
-        setTrackbarMin("threshold*.001(bound 1)", name_, int(minV*1000));
-        setTrackbarMin("threshold*.001(bound 2)", name_, int(minV*1000));
-        setTrackbarMax("threshold*.001(bound 1)", name_, int(maxV*1000));
-        setTrackbarMax("threshold*.001(bound 2)", name_, int(maxV*1000));
-        //Mat show = (res >= (min(threshold1_, threshold2_) / 1000.)) <= (max(threshold1_, threshold2_) / 1000.);
-        imshow(name_, res);
-        return res;
+        flight_() = &f;
+        for (size_t i = begin; i < end && i < filters_.size(); ++i)
+            f.image = filters_[i]->filter(f.image);
+        if (end >= filters_.size() && apply_)
+            apply_(f.image);
+        flight_() = 0;
     }
-    int ksize_;
-    int threshold1_;
-    int threshold2_;
-};
-
-class norm_minmax_filter : public itf_filter
-{
-public:
-    norm_minmax_filter(const string& name) : itf_filter(name)
+	void bringTop(int i)
+	{
+		if (i < filters_.size())
+		{
+			filters_[i]->bringTop();
+			top(i);
+		}
+	}
+	void bringTop()
+	{
+		if (!filters_.empty())
+		{
+			filters_.back()->bringTop();
+			top(filters_.size() - 1);
+		}
+	}
+    // which windows are redrawn when their filter runs.
+    enum display_mode
     {
-        op_ = 0;
-        switch_ = 1;
-        threshold_ = 128;
-        createTrackbar("threshold*.001", name_, &threshold_, 1000, itf_filter::update_, this);
-        createTrackbar("(full,<,>,<=,>=)", name_, &op_, 4, itf_filter::update_, this);
-        createTrackbar("normalize (OFF/ON)", name_, &op_, 1, itf_filter::update_, this);
+        display_all,    // every window, every time
+        display_top,    // only the one last brought to top by bringTop
+        display_fps,    // every window, at most fps times a second
+        display_demand, // none, until refresh()
+    };
+    void display_policy(display_mode mode, double fps = 10.)
+    {
+        lock_guard<mutex> lock(mutex_);
+        display_ = mode;
+        display_fps_ = max(fps, .1);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    display_mode display_policy() const { return display_; }
+    // draw every window once, for display_demand.
+    void refresh()
     {
-        Mat res;
-        if (switch_)
-            normalize(image, res, 0, 1, NORM_MINMAX);
-        switch (op_)
         {
-        case 1: res = res < threshold_*.001; break;
-        case 2: res = res > threshold_*.001; break;
-        case 3: res = res <= threshold_*.001; break;
-        case 4: res = res >= threshold_*.001; break;
+            lock_guard<mutex> lock(mutex_);
+            refresh_ = true;
         }
-        imshow(name_, res);
-        return res;
-    }
-    int threshold_;
-    int op_;
-    int switch_;
-};
-
-class warpAffine_filter;
-class warpAffine_filter : public itf_filter
-{
-public:
-    warpAffine_filter(const string& name) : itf_filter(name)
-    {
-        motion_ = 2;
-        size_ = 200;
-        createTrackbar("TRANSLATION/EUCLIDEAN/AFFINE", name_, &motion_, 2, itf_filter::update_, this);
-        createTrackbar("size", name_, &size_, 8192, itf_filter::update_, this);
+        redraw_(0);
     }
 protected:
-    virtual Mat _filter(Mat& image)
+    // stages before dirty_ keep their last output in outs_,
+    // only dirty_..N are run again.
+    Mat filter()
     {
-        setTrackbarMax("size", name_, image.cols);
-        Mat res;
-        Mat warpGround;
-        RNG rng(getTickCount());
-        double angle;
-        switch (motion_)
+        size_t i = min(dirty_, filters_.size());
+        // not run for this frame, e.g. upstream of a replayed stage.
+        while (i > 0 && !ran_[i - 1])
+            --i;
+        Mat res = (i == 0) ? tmp_ : outs_[i - 1];
+        for (; i < filters_.size(); ++i)
         {
-        case 0: //MOTION_TRANSLATION:
-            warpGround = (Mat_<float>(2,3) << 1, 0, (rng.uniform(10.f, 20.f)),
-                0, 1, (rng.uniform(10.f, 20.f)));
-            //warpAffine(image, res, warpGround,
-            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
-            break;
-        case 1: //MOTION_EUCLIDEAN:
-            angle = CV_PI/30 + CV_PI*rng.uniform((double)-2.f, (double)2.f)/180;
-
-            warpGround = (Mat_<float>(2,3) << cos(angle), -sin(angle), (rng.uniform(10.f, 20.f)),
-                sin(angle), cos(angle), (rng.uniform(10.f, 20.f)));
-            //warpAffine(image, res, warpGround,
-            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
-            break;
-        case 2: //MOTION_AFFINE:
-
-            warpGround = (Mat_<float>(2,3) << (1-rng.uniform(-0.05f, 0.05f)),
-                (rng.uniform(-0.03f, 0.03f)), (rng.uniform(10.f, 20.f)),
-                (rng.uniform(-0.03f, 0.03f)), (1-rng.uniform(-0.05f, 0.05f)),
-                (rng.uniform(10.f, 20.f)));
-            //warpAffine(image, res, warpGround,
-            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
-            break;
-        case 3: //MOTION_HOMOGRAPHY:
-            warpGround = (Mat_<float>(3,3) << (1-rng.uniform(-0.05f, 0.05f)),
-                (rng.uniform(-0.03f, 0.03f)), (rng.uniform(10.f, 20.f)),
-                (rng.uniform(-0.03f, 0.03f)), (1-rng.uniform(-0.05f, 0.05f)),(rng.uniform(10.f, 20.f)),
-                (rng.uniform(0.0001f, 0.0003f)), (rng.uniform(0.0001f, 0.0003f)), 1.f);
-            //warpPerspective(image, res, warpGround,
-            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
-            break;
+            int64 version = version_of_(i);
+            if (!fetch_(cache_.get(), i, index_, version, res, retmp_))
+            {
+                size_t last = fuse_(i, res);
+                if (last > i)
+                {
+                    // stages i..last-1 run inside last, they have no output of their own.
+                    while (i < last)
+                    {
+                        outs_[i] = Mat();
+                        ran_[i++] = 0;
+                    }
+                    version = version_of_(i);
+                }
+                res = filters_[i]->filter(res);
+                store_(cache_.get(), i, index_, version, res, retmp_);
+            }
+            outs_[i] = res;
+            ran_[i] = 1;
         }
-        warpAffine(image, res, warpGround, Size(size_, size_), INTER_LINEAR + WARP_INVERSE_MAP);
-        imshow(name_, res);
+        dirty_ = filters_.size();
+        refresh_ = false;
+        if (apply_)
+            apply_(res);
         return res;
     }
-    int motion_;
-    int size_;
-};
-class warpPerspective_filter;
-class warpPerspective_filter : public itf_filter
-{
-public:
-    warpPerspective_filter(const string& name) : itf_filter(name)
+    // origin, if not empty, replaces it with the seed, see update_origin.
+    void filter_next(itf_filter* f, Mat image, Mat origin = Mat())
     {
-        motion_ = 3;
-        size_ = 200;
-        createTrackbar("size", name_, &size_, 8192, itf_filter::update_, this);
+        size_t i = index_of(f);
+        if (i < filters_.size() && worker_.joinable())
+        {
+            lock_guard<mutex> lock(mutex_);
+            seed_i_ = (int)i;
+            seed_ = image;
+            seed_origin_ = origin;
+            version_[i] = ++gen_;
+            if (dirty_ > i)
+                dirty_ = i + 1;
+            cond_.notify_one();
+        }
+        else if (i < filters_.size())
+        {
+            if (!origin.empty())
+                update_origin(origin);
+            version_[i] = ++gen_;
+            outs_[i] = image;
+            ran_[i] = 1;
+            if (dirty_ > i)
+                dirty_ = i + 1;
+            filter();
+        }
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    size_t index_of(const itf_filter* f) const
     {
-        setTrackbarMax("size", name_, image.cols);
-        Mat res;
-        Mat warpGround;
-        RNG rng(getTickCount());
-        double angle;
-        switch (motion_)
+        size_t i = 0;
+        for (; i < filters_.size(); ++i)
         {
-        case 3: //MOTION_HOMOGRAPHY:
-        default:
-            warpGround = (Mat_<float>(3,3) << (1-rng.uniform(-0.05f, 0.05f)),
-                (rng.uniform(-0.03f, 0.03f)), (rng.uniform(10.f, 20.f)),
-                (rng.uniform(-0.03f, 0.03f)), (1-rng.uniform(-0.05f, 0.05f)),(rng.uniform(10.f, 20.f)),
-                (rng.uniform(0.0001f, 0.0003f)), (rng.uniform(0.0001f, 0.0003f)), 1.f);
-            //warpPerspective(image, res, warpGround,
-            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
-            break;
+            if (filters_[i].get() == f)
+                break;
         }
-        warpPerspective(image, res, warpGround, Size(size_, size_), INTER_LINEAR + WARP_INVERSE_MAP);
-        imshow(name_, res);
-        return res;
+        return i;
     }
-    int motion_;
-    int size_;
-};
-
-class remap_filter;
-
-class warpPolar_filter;
-class warpPolar_filter : public itf_filter
-{
-public:
-    warpPolar_filter(const string& name) : itf_filter(name)
+    void invalidate(size_t i) { dirty_ = min(dirty_, i); }
+    void request(size_t i)
     {
-        x_ = 50;
-        y_ = 50;
-        radius_ = 70;
-        flag_ = 0;
-        inv_ = 0;
-        createTrackbar("x (0~100%)", name_, &x_, 100, itf_filter::update_, this);
-        createTrackbar("y (0~100%)", name_, &y_, 100, itf_filter::update_, this);
-        createTrackbar("radius (0~100%)", name_, &radius_, 100, itf_filter::update_, this);
-        createTrackbar("LINEAR/LOG", name_, &flag_, 1, itf_filter::update_, this);
-        createTrackbar("INVERSE (OFF/ON)", name_, &inv_, 1, itf_filter::update_, this);
+        if (!worker_.joinable())
+        {
+            version_[i] = ++gen_;
+            invalidate(i);
+            filter();
+            return;
+        }
+        lock_guard<mutex> lock(mutex_);
+        version_[i] = ++gen_;
+        invalidate(i);
+        pdirty_ = min(pdirty_, i);
+        changed_ = chrono::steady_clock::now();
+        cond_.notify_one();
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    void run_async_();
+    void evaluate_(unique_lock<mutex>& lock, bool proxy);
+    // draw the windows of stages i.. that are due from what they
+    // computed and did not show. trackbars did not move, so only a
+    // stage without such a drawing is run again, from itself on.
+    void redraw_(size_t i)
     {
-        Mat res;
-        Point2f pt( (float)image.cols * x_ / 100., (float)image.rows * y_ / 100. );
-        double maxRadius = radius_ * min(pt.y, pt.x) / 100.;
-        int flags = ((flag_)? WARP_POLAR_LOG:WARP_POLAR_LINEAR)
-                    + ((inv_)?WARP_INVERSE_MAP:0);
-
-        warpPolar(image, res, Size(),pt, maxRadius, flags);
-
-        imshow(name_, res);
-        return res;
+        for (; i < filters_.size(); ++i)
+        {
+            itf_filter& f = *filters_[i];
+            if (!visible_(&f))
+                continue;
+            function<Mat()> draw;
+            double s;
+            {
+                lock_guard<mutex> lock(mutex_);
+                if (f.redo_)
+                {
+                    // due again, for the run below to draw it.
+                    if (i < shown_.size())
+                        shown_[i] = chrono::steady_clock::time_point();
+                    break;
+                }
+                draw.swap(f.pending_);
+                s = f.pending_scale_;
+            }
+            if (draw)
+                f.show_(draw(), s);
+        }
+        if (i == filters_.size())
+        {
+            lock_guard<mutex> lock(mutex_);
+            refresh_ = false;
+            return;
+        }
+        if (!worker_.joinable())
+        {
+            if (!tmp_.empty())
+            {
+                invalidate(i);
+                filter();
+            }
+            return;
+        }
+        lock_guard<mutex> lock(mutex_);
+        if (!tmp_.empty())
+        {
+            invalidate(i);
+            cond_.notify_one();
+        }
     }
-    int x_;
-    int y_;
-    int radius_;
-    int flag_;
-    int inv_;
-};
-
-class pyrDown_filter : public itf_filter
-{
-public:
-    pyrDown_filter(const string& name) : itf_filter(name)
+    void top(size_t i)
     {
-        x_ = 50;
-        y_ = 50;
-        createTrackbar("x (0~100%)", name_, &x_, 100, itf_filter::update_, this);
-        createTrackbar("y (0~100%)", name_, &y_, 100, itf_filter::update_, this);
+        bool moved;
+        {
+            lock_guard<mutex> lock(mutex_);
+            moved = display_ == display_top && top_ != (int)i;
+            top_ = (int)i;
+        }
+        if (moved)
+            redraw_(i);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    bool visible_(const itf_filter* f);
+    // the stage that runs stages i.. up to it as one, i if none. with
+    // the output of stages before i drawn, no frame_store recording.
+    size_t fuse_(size_t i, const Mat& image);
+    // two morphology filters in a row, see morphology_filter.
+    size_t fuse_morph_(size_t i);
+    // a run of point ops, as one table.
+    size_t fuse_points_(size_t i, const Mat& image);
+    // whether the window of stage i is left alone this evaluation.
+    bool hidden_(size_t i);
+    // stage i is fused into a later one and does not run.
+    void skip_(size_t i);
+    static void apply_lut_(const Mat& src, const Mat& table, Mat& dst);
+    // stage i depends on the trackbars of stages 0..i.
+    int64 version_of_(size_t i) const
     {
-        Mat res;
-        pyrDown(image, res, Size(image.cols * x_ / 100, (float)image.rows *x_ / 100.));
-        imshow(name_, res);
-        return res;
+        int64 v = 0;
+        for (size_t j = 0; j <= i && j < version_.size(); ++j)
+            v = max(v, version_[j]);
+        return v;
     }
-    int x_;
-    int y_;
-};
-
-class pyrUp_filter : public itf_filter
-{
-public:
-    pyrUp_filter(const string& name) : itf_filter(name)
+    bool fetch_(frame_cache* cache, size_t i, int64 index, int64 version, Mat& image, Mat& retmp);
+    void store_(frame_cache* cache, size_t i, int64 index, int64 version, const Mat& image, const Mat& retmp);
+    bool proxy_ok_() const
     {
-        x_ = 200;
-        y_ = 200;
-        createTrackbar("x (0~100%)", name_, &x_, 200, itf_filter::update_, this);
-        createTrackbar("y (0~100%)", name_, &y_, 200, itf_filter::update_, this);
+        for (size_t i = 0; i < filters_.size(); ++i)
+        {
+            if (!filters_[i]->proxy_ok_())
+                return false;
+        }
+        return true;
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    static frame*& flight_()
     {
-        Mat res;
-        pyrUp(image, res, Size(image.cols * x_ / 100, (float)image.rows * x_ / 100.));
-        imshow(name_, res);
-        return res;
+        static thread_local frame* f = 0;
+        return f;
     }
-    int x_;
-    int y_;
-};
-
-// demonstrates
-class dem_filter : public itf_filter
-{
-public:
-    dem_filter(const string& name) : itf_filter(name)
+    typedef vector<pair<string, function<void()> > > gui_calls;
+    static gui_calls*& staging_()
     {
-        brightness_ = 100;
-        contrast_ = 100;
-        createTrackbar("brightness-100", name_, &brightness_, 200, itf_filter::update_, this);
-        createTrackbar("contrast-100", name_, &contrast_, 200, itf_filter::update_, this);
+        static thread_local gui_calls* calls = 0;
+        return calls;
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    // runs f now, or stages it under key when called by the worker.
+    static void gui_(const string& key, function<void()> f)
     {
-        Mat res;
-        int brightness = brightness_ - 100;
-        int contrast = contrast_ - 100;
-        /*
-         * The algorithm is by Werner D. Streidt
-         * (http://visca.com/ffactory/archives/5-99/msg00021.html)
-         */
-        double a, b;
-        if( contrast > 0 )
+        gui_calls* calls = staging_();
+        if (!calls)
         {
-            double delta = 127.*contrast/100;
-            a = 255./(255. - delta*2);
-            b = a*(brightness - delta);
+            f();
+            return;
         }
-        else
+        for (size_t i = 0; i < calls->size(); ++i)
         {
-            double delta = -128.*contrast/100;
-            a = (256.-delta*2)/255.;
-            b = a*brightness + delta;
+            if ((*calls)[i].first == key)
+            {
+                (*calls)[i].second = f;
+                return;
+            }
         }
-        image.convertTo(res, CV_8U, a, b);
-        imshow(name_, res);
-        return res;
+        calls->push_back(make_pair(key, f));
     }
-    int brightness_;
-    int contrast_;
+    friend class itf_filter;
+    vector<sptr_filter> filters_;
+    string cmd_;
+    vector<Mat> outs_;
+    // outs_[i] is of the current frame. stages upstream of a replayed
+    // one, or fused into a later one, did not run; the stages after
+    // them start from the last one that did.
+    vector<char> ran_;
+    // stages set by tap().
+    vector<char> taps_;
+    // bumped on a trackbar change of the stage, from gen_.
+    vector<int64> version_;
+    int64 gen_;
+    int64 index_;
+    shared_ptr<frame_cache> cache_;
+    shared_ptr<frame_store> recorder_;
+    // filter_from: outputs before seed_i_ are not of this frame.
+    bool seed_clear_;
+    // see fusion().
+    bool fusion_;
+    size_t dirty_;
+    Mat tmp_;
+    Mat retmp_;
+    function<void(Mat)> apply_;
+    int seed_i_;
+    Mat seed_;
+    Mat seed_origin_;
+    bool stop_;
+    gui_calls ready_;
+    // the proxy has its own input, cache, watermark and origin.
+    vector<Mat> pouts_;
+    vector<char> pran_;
+    size_t pdirty_;
+    Mat ptmp_;
+    Mat pretmp_;
+    double pscale_;
+    int proxy_side_;
+    int idle_ms_;
+    chrono::steady_clock::time_point changed_;
+    display_mode display_;
+    double display_fps_;
+    int top_;
+    bool refresh_;
+    // per stage, when its window was last drawn and whether a draw
+    // has been skipped since, for display_fps.
+    vector<chrono::steady_clock::time_point> shown_;
+    vector<char> missed_;
+    mutex mutex_;
+    condition_variable cond_;
+    thread worker_;
 };
 
-class distrans_filter : public itf_filter
+void filter_graph::async(bool on)
 {
-public:
-    distrans_filter(const string& name) : itf_filter(name)
+    if (on == worker_.joinable())
+        return;
+    if (on)
     {
-        maskSize0_ = DIST_MASK_5;
-        voronoiType_ = -1;
-        edgeThresh_ = 100;
-        distType0_ = DIST_L1;
-        method_ = 0;
-        createTrackbar("Brightness Threshold", name_, &edgeThresh_, 255, itf_filter::update_, this);
-        createTrackbar("method:\n"
-            "0 - use C/Inf metric\n"
-            "1 - use L1 metric\n"
-            "2 - use L2 metric\n"
-            "3 - use 3x3 mask\n"
-            "4 - use 5x5 mask\n"
-            "5 - use precise distance transform\n"
-            "6 - switch to Voronoi diagram mode\n"
-            "7 - switch to pixel-based Voronoi diagram mode\n", name_,
-            &method_, 7, itf_filter::update_, this);
-
+        stop_ = false;
+        worker_ = thread(&filter_graph::run_async_, this);
+        return;
     }
-protected:
-    virtual Mat _filter(Mat& image)
     {
-        Mat gray = image;
-        Mat res;
-        if (method_ < 6)
-            voronoiType_ = -1;
-        switch (method_)
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+        cond_.notify_one();
+    }
+    worker_.join();
+}
+
+void filter_graph::run_async_()
+{
+    unique_lock<mutex> lock(mutex_);
+    for (;;)
+    {
+        cond_.wait(lock, [this](){
+            return stop_ || dirty_ < filters_.size() || seed_i_ >= 0;
+        });
+        if (stop_)
+            break;
+        chrono::steady_clock::time_point idle = changed_ + chrono::milliseconds(idle_ms_);
+        if (proxy_side_ > 0 && seed_i_ < 0 && !tmp_.empty() && proxy_ok_()
+            && chrono::steady_clock::now() < idle)
         {
-        case 0: distType0_ = DIST_C; break;
-        case 1: distType0_ = DIST_L1; break;
-        case 2: distType0_ = DIST_L2; break;
-        case 3: maskSize0_ = DIST_MASK_3; break;
-        case 4: maskSize0_ = DIST_MASK_5; break;
-        case 5: maskSize0_ = DIST_MASK_PRECISE; break;
-        case 6: voronoiType_ = 0; break;
-        case 7: voronoiType_ = 1; break;
+            if (pdirty_ < filters_.size())
+                evaluate_(lock, true);
+            cond_.wait_until(lock, idle, [this](){
+                return stop_ || pdirty_ < filters_.size();
+            });
+            continue;
         }
+        evaluate_(lock, false);
+    }
+}
 
-        static const Scalar colors[] =
+// one run over the dirty stages, at full size or on the proxy.
+// lock is held on entry and on return.
+void filter_graph::evaluate_(unique_lock<mutex>& lock, bool proxy)
+{
+    vector<Mat>& outs = proxy ? pouts_ : outs_;
+    vector<char>& ran = proxy ? pran_ : ran_;
+    size_t& dirty = proxy ? pdirty_ : dirty_;
+    Mat& retmp = proxy ? pretmp_ : retmp_;
+    size_t i = dirty;
+    dirty = filters_.size();
+    // the proxy is never cached, its outputs are of another size.
+    int64 index = proxy ? -1 : index_;
+    shared_ptr<frame_cache> cache = cache_;
+    frame f;
+    if (proxy)
+    {
+        if (ptmp_.empty())
         {
-            Scalar(0,0,0),
-            Scalar(255,0,0),
-            Scalar(255,128,0),
-            Scalar(255,255,0),
-            Scalar(0,255,0),
-            Scalar(0,128,255),
-            Scalar(0,255,255),
-            Scalar(0,0,255),
-            Scalar(255,0,255)
-        };
-
-        int maskSize = voronoiType_ >= 0 ? DIST_MASK_5 : maskSize0_;
-        int distType = voronoiType_ >= 0 ? DIST_L2 : distType0_;
+            pscale_ = min(1., (double)proxy_side_ / max(tmp_.cols, tmp_.rows));
+            resize(tmp_, ptmp_, Size(), pscale_, pscale_, INTER_AREA);
+            pretmp_ = Mat();
+            i = 0;
+        }
+        f.tmp = ptmp_;
+        f.scale = pscale_;
+    }
+    else
+    {
+        if (seed_i_ >= 0 && i > (size_t)seed_i_)
+        {
+            outs_[seed_i_] = seed_;
+            ran_[seed_i_] = 1;
+            if (!seed_origin_.empty())
+                retmp_ = seed_origin_;
+            for (int j = 0; seed_clear_ && j < seed_i_; ++j)
+            {
+                outs_[j] = Mat();
+                ran_[j] = 0;
+            }
+        }
+        seed_i_ = -1;
+        seed_ = Mat();
+        seed_origin_ = Mat();
+        seed_clear_ = false;
+        f.tmp = tmp_;
+    }
+    while (i > 0 && !ran[i - 1])
+        --i;
+    f.retmp = retmp;
+    lock.unlock();
 
-        Mat edge = gray >= edgeThresh_, dist, labels, dist8u;
+    gui_calls staged;
+    staging_() = &staged;
+    flight_() = &f;
+    f.image = (i == 0) ? f.tmp : outs[i - 1];
+    bool stale = false;
+    for (; i < filters_.size(); ++i)
+    {
+        int64 version;
+        {
+            // a change upstream of i makes the rest of this run stale,
+            // changes from i on are picked up by the stages still to run.
+            lock_guard<mutex> guard(mutex_);
+            if (dirty < i || stop_)
+            {
+                stale = true;
+                break;
+            }
+            dirty = filters_.size();
+            version = version_of_(i);
+        }
+        if (!fetch_(cache.get(), i, index, version, f.image, f.retmp))
+        {
+            size_t last = fuse_(i, f.image);
+            if (last > i)
+            {
+                while (i < last)
+                {
+                    outs[i] = Mat();
+                    ran[i++] = 0;
+                }
+                lock_guard<mutex> guard(mutex_);
+                version = version_of_(i);
+            }
+            f.image = filters_[i]->filter(f.image);
+            store_(cache.get(), i, index, version, f.image, f.retmp);
+        }
+        outs[i] = f.image;
+        ran[i] = 1;
+    }
+    if (!stale && !proxy && apply_)
+        apply_(f.image);
+    staging_() = 0;
+    flight_() = 0;
 
-        if( voronoiType_ < 0 )
-            distanceTransform(edge, dist, distType, maskSize);
+    lock.lock();
+    if (stale)
+    {
+        dirty = min(dirty, i);
+        return;
+    }
+    if (!proxy)
+        refresh_ = false;
+    retmp = f.retmp;
+    for (size_t k = 0; k < staged.size(); ++k)
+    {
+        size_t j = 0;
+        for (; j < ready_.size() && ready_[j].first != staged[k].first; ++j)
+            ;
+        if (j < ready_.size())
+            ready_[j].second = staged[k].second;
         else
-            distanceTransform(edge, dist, labels, distType, maskSize, voronoiType_);
+            ready_.push_back(staged[k]);
+    }
+}
 
-        if( voronoiType_ < 0 )
+void filter_graph::present()
+{
+    gui_calls calls;
+    size_t redraw = filters_.size();
+    {
+        lock_guard<mutex> lock(mutex_);
+        calls.swap(ready_);
+        // throttled windows get their last result once the interval is over.
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        chrono::duration<double> interval(1. / display_fps_);
+        for (size_t i = 0; display_ == display_fps && i < missed_.size(); ++i)
         {
-            // begin "painting" the distance transform result
-            dist *= 5000;
-            pow(dist, 0.5, dist);
-
-            Mat dist32s, dist8u1, dist8u2;
-
-            dist.convertTo(dist32s, CV_32S, 1, 0.5);
-            dist32s &= Scalar::all(255);
+            if (missed_[i] && now - shown_[i] >= interval)
+            {
+                redraw = i;
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < calls.size(); ++i)
+        calls[i].second();
+    if (redraw < filters_.size())
+        redraw_(redraw);
+}
 
-            dist32s.convertTo(dist8u1, CV_8U, 1, 0);
-            dist32s *= -1;
+bool filter_graph::fetch_(frame_cache* cache, size_t i, int64 index, int64 version, Mat& image, Mat& retmp)
+{
+    if (!cache || index < 0)
+        return false;
+    itf_filter& f = *filters_[i];
+    f.begin_display_();
+    frame_cache::key k = { index, (int)i, version };
+    frame_cache::entry e;
+    // the window is to be drawn, but its drawing was skipped when stored.
+    if (!cache->get(k, e) || (f.visible() && e.shown.empty()))
+    {
+        f.display_set_ = true;
+        return false;
+    }
+    if (!e.shown.empty())
+        f.display(e.shown);
+    else
+        f.pend_(nullptr, true);
+    image = e.out;
+    retmp = e.origin;
+    return true;
+}
 
-            dist32s += Scalar::all(255);
-            dist32s.convertTo(dist8u2, CV_8U);
+void filter_graph::store_(frame_cache* cache, size_t i, int64 index, int64 version, const Mat& image, const Mat& retmp)
+{
+    if (index < 0 || image.empty())
+        return;
+    if (recorder_)
+        recorder_->append(index, (int)i, image);
+    if (!cache)
+        return;
+    frame_cache::key k = { index, (int)i, version };
+    frame_cache::entry e;
+    e.out = image;
+    e.shown = filters_[i]->shown_;
+    e.origin = retmp;
+    cache->put(k, e);
+}
 
-            Mat planes[] = {dist8u1, dist8u2, dist8u2};
-            merge(planes, 3, dist8u);
-        }
-        else
+bool filter_graph::visible_(const itf_filter* f)
+{
+    if (itf_filter::headless())
+        return false;
+    lock_guard<mutex> lock(mutex_);
+    size_t i = index_of(f);
+    switch (display_)
+    {
+    case display_top:
+        return i == (top_ < 0 ? filters_.size() - 1 : (size_t)top_);
+    case display_fps:
         {
-            dist8u.create(labels.size(), CV_8UC3);
-            for( int i = 0; i < labels.rows; i++ )
+            if (shown_.size() != filters_.size())
             {
-                const int* ll = (const int*)labels.ptr(i);
-                const float* dd = (const float*)dist.ptr(i);
-                uchar* d = (uchar*)dist8u.ptr(i);
-                for( int j = 0; j < labels.cols; j++ )
-                {
-                    int idx = ll[j] == 0 || dd[j] == 0 ? 0 : (ll[j]-1)%8 + 1;
-                    float scale = 1.f/(1 + dd[j]*dd[j]*0.0004f);
-                    int b = cvRound(colors[idx][0]*scale);
-                    int g = cvRound(colors[idx][1]*scale);
-                    int r = cvRound(colors[idx][2]*scale);
-                    d[j*3] = (uchar)b;
-                    d[j*3+1] = (uchar)g;
-                    d[j*3+2] = (uchar)r;
-                }
+                shown_.assign(filters_.size(), chrono::steady_clock::time_point());
+                missed_.assign(filters_.size(), 0);
             }
+            if (i >= filters_.size())
+                return true;
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if (now - shown_[i] < chrono::duration<double>(1. / display_fps_))
+            {
+                missed_[i] = 1;
+                return false;
+            }
+            shown_[i] = now;
+            missed_[i] = 0;
+            return true;
         }
-        res = dist8u;
-        imshow(name_, dist8u);
-        return res;
+    case display_demand:
+        return refresh_;
+    default:
+        return true;
     }
-    int maskSize0_;
-    int voronoiType_;
-    int edgeThresh_;
-    int distType0_;
-    int method_;
-};
+}
 
-// apply:
-// contours
+void itf_filter::begin_display_()
+{
+    if (headless())
+        visible_ = false;
+    else
+        visible_ = graph_ ? graph_->visible_(this) : true;
+}
 
-/**
-imgproc
-CV_EXPORTS_W void medianBlur( InputArray src, OutputArray dst, int ksize );
-CV_EXPORTS_W void GaussianBlur( InputArray src, OutputArray dst, Size ksize,
-CV_EXPORTS_W void bilateralFilter( InputArray src, OutputArray dst, int d,
-CV_EXPORTS_W void boxFilter( InputArray src, OutputArray dst, int ddepth,
-CV_EXPORTS_W void sqrBoxFilter( InputArray src, OutputArray dst, int ddepth,
-CV_EXPORTS_W void blur( InputArray src, OutputArray dst,
-CV_EXPORTS_W void filter2D( InputArray src, OutputArray dst, int ddepth,
-CV_EXPORTS_W void sepFilter2D( InputArray src, OutputArray dst, int ddepth,
-CV_EXPORTS_W void Sobel( InputArray src, OutputArray dst, int ddepth,
-CV_EXPORTS_W void Scharr( InputArray src, OutputArray dst, int ddepth,
-CV_EXPORTS_W void Laplacian( InputArray src, OutputArray dst, int ddepth,
-CV_EXPORTS_W void cornerMinEigenVal( InputArray src, OutputArray dst,
-CV_EXPORTS_W void cornerHarris( InputArray src, OutputArray dst, int blockSize,
-CV_EXPORTS_W void cornerEigenValsAndVecs( InputArray src, OutputArray dst,
-CV_EXPORTS_W void preCornerDetect( InputArray src, OutputArray dst, int ksize,
-CV_EXPORTS_W void erode( InputArray src, OutputArray dst, InputArray kernel,
-CV_EXPORTS_W void dilate( InputArray src, OutputArray dst, InputArray kernel,
-CV_EXPORTS_W void morphologyEx( InputArray src, OutputArray dst,
-CV_EXPORTS_W void resize( InputArray src, OutputArray dst,
-CV_EXPORTS_W void warpAffine( InputArray src, OutputArray dst,
-CV_EXPORTS_W void warpPerspective( InputArray src, OutputArray dst,
-CV_EXPORTS_W void remap( InputArray src, OutputArray dst,
-                               OutputArray dstmap1, OutputArray dstmap2,
-CV_EXPORTS_W void logPolar( InputArray src, OutputArray dst,
-CV_EXPORTS_W void linearPolar( InputArray src, OutputArray dst,
-CV_EXPORTS_W void warpPolar(InputArray src, OutputArray dst, Size dsize,
-CV_EXPORTS_W void accumulate( InputArray src, InputOutputArray dst,
-CV_EXPORTS_W void accumulateSquare( InputArray src, InputOutputArray dst,
-                                     InputOutputArray dst, InputArray mask=noArray() );
-CV_EXPORTS_W void accumulateWeighted( InputArray src, InputOutputArray dst,
-CV_EXPORTS_W void createHanningWindow(OutputArray dst, Size winSize, int type);
-CV_EXPORTS_W double threshold( InputArray src, OutputArray dst,
-CV_EXPORTS_W void adaptiveThreshold( InputArray src, OutputArray dst,
-CV_EXPORTS_W void pyrDown( InputArray src, OutputArray dst,
-CV_EXPORTS_W void pyrUp( InputArray src, OutputArray dst,
-CV_EXPORTS_W void undistort( InputArray src, OutputArray dst,
-CV_EXPORTS_W void undistortPoints( InputArray src, OutputArray dst,
-CV_EXPORTS_AS(undistortPointsIter) void undistortPoints( InputArray src, OutputArray dst,
-                                   InputArray hist, OutputArray dst,
-CV_EXPORTS_W void equalizeHist( InputArray src, OutputArray dst );
-CV_EXPORTS_W void pyrMeanShiftFiltering( InputArray src, OutputArray dst,
-CV_EXPORTS_AS(distanceTransformWithLabels) void distanceTransform( InputArray src, OutputArray dst,
-CV_EXPORTS_W void distanceTransform( InputArray src, OutputArray dst,
-CV_EXPORTS void blendLinear(InputArray src1, InputArray src2, InputArray weights1, InputArray weights2, OutputArray dst);
-CV_EXPORTS_W void cvtColor( InputArray src, OutputArray dst, int code, int dstCn = 0 );
-CV_EXPORTS_W void cvtColorTwoPlane( InputArray src1, InputArray src2, OutputArray dst, int code );
-CV_EXPORTS_W void demosaicing(InputArray src, OutputArray dst, int code, int dstCn = 0);
-CV_EXPORTS_W void applyColorMap(InputArray src, OutputArray dst, int colormap);
-CV_EXPORTS_W void applyColorMap(InputArray src, OutputArray dst, InputArray userColor);
+void itf_filter::update_(int pos, void* userdata)
+{
+    itf_filter* f = (itf_filter*)userdata;
+    if (f && !f->graph_->tmp_.empty())
+        f->graph_->request(f->graph_->index_of(f));
+}
 
-**/
+double itf_filter::scale() const
+{
+    return graph_ ? graph_->scale() : 1.;
+}
 
-/**
-core
+void itf_filter::trackbar_min(const string& label, int v)
+{
+    string window = name_;
+    if (!headless())
+        filter_graph::gui_("min " + label + window, [=](){
+            setTrackbarMin(label, window, v);
+        });
+}
 
-**/
-class channel_filter : public itf_filter
+void itf_filter::trackbar_max(const string& label, int v)
+{
+    string window = name_;
+    if (!headless())
+        filter_graph::gui_("max " + label + window, [=](){
+            setTrackbarMax(label, window, v);
+        });
+}
+
+// the value is set at once, _filter may read it back in the same run.
+void itf_filter::trackbar_pos(const string& label, int v)
+{
+    for_each(trackbars_.begin(), trackbars_.end(),
+             [&](param& p){
+                if (p.label == label)
+                    *p.value = v;
+             });
+    string window = name_;
+    if (!headless())
+        filter_graph::gui_("pos " + label + window, [=](){
+            setTrackbarPos(label, window, v);
+        });
+}
+
+void itf_filter::display(const Mat& image)
+{
+    displayed_ = true;
+    if (!visible())
+    {
+        pend_([image](){ return image; });
+        return;
+    }
+    pend_(nullptr);
+    shown_ = image;
+    show_(image, scale());
+}
+
+void itf_filter::draw_(function<Mat()> draw)
+{
+    if (visible())
+        display(draw());
+    else
+    {
+        displayed_ = true;
+        pend_(draw);
+    }
+}
+
+void itf_filter::pend_(function<Mat()> draw, bool redo)
+{
+    if (headless() || !graph_)
+        return;
+    double s = scale();
+    lock_guard<mutex> lock(graph_->mutex_);
+    pending_ = draw;
+    pending_scale_ = s;
+    redo_ = redo;
+}
+
+void itf_filter::show_(const Mat& image, double s)
+{
+    string window = name_;
+    Mat show = image;
+    // keep the window at full size while showing the proxy.
+    if (s < 1. && !image.empty())
+        resize(image, show, Size(cvRound(image.cols / s), cvRound(image.rows / s)), 0, 0, INTER_NEAREST);
+    filter_graph::gui_("imshow " + window, [=](){
+        imshow(window, show);
+    });
+}
+
+void itf_filter::update_next_(Mat image, Mat origin)
+{
+    graph_->filter_next(this, image, origin);
+}
+
+unique_lock<mutex> itf_filter::lock_()
+{
+    return graph_ ? unique_lock<mutex>(graph_->mutex_) : unique_lock<mutex>();
+}
+
+atomic<int> itf_filter::snum_(0);
+
+class noop_filter : public itf_filter
 {
 public:
-    channel_filter(const string& name) : itf_filter(name)
+    noop_filter(const string& name) : itf_filter(name)
     {
-        op_ = 0;
-        channel_ = 0;
-        threshold1_ = 128;
-        threshold2_ = 128;
-        createTrackbar("threshold 1", name_, &threshold1_, 255, itf_filter::update_, this);
-        createTrackbar("threshold 2", name_, &threshold2_, 255, itf_filter::update_, this);
-        createTrackbar("(full,range,<|>,&,^,|,&~)", name_, &op_, 6, itf_filter::update_, this);
-        createTrackbar("channel (0-3)", name_, &channel_, 3, itf_filter::update_, this);
+        noop_ = 128;
+        add_trackbar("noop", &noop_, 256);
     }
 protected:
     virtual Mat _filter(Mat& image)
     {
-        Mat res(image.size(), CV_8U);
-        Mat mask;
-        int ch[] = {std::min((image.type() >> CV_CN_SHIFT), channel_), 0};
-        mixChannels(&image, 1, &res, 1, ch, 1);
-        switch (op_)
-        {
-        case 1:
-            inRange(res, Scalar(min(threshold1_, threshold2_)), Scalar(max(threshold1_, threshold2_)), mask);
-            bitwise_and(mask, res, res);
-            break;
-        case 2:
-            inRange(res, Scalar(min(threshold1_, threshold2_)), Scalar(max(threshold1_, threshold2_)), mask);
-            bitwise_and(~mask, res, res);
-            break;
-        case 3: res = res & threshold1_; break;
-        case 4: res = res ^ threshold1_; break;
-        case 5: res = res | threshold1_; break;
-        case 6: res = res & (~threshold1_ & 0xff); break;
-        }
-        imshow(name_, res);
+        Mat res;
+        (void)image;
         return res;
     }
-    int op_;
-    int channel_;
-    int threshold1_, threshold2_;
+    int noop_;
 };
 
-class bgr2gray_filter : public itf_filter
+class threshold_filter : public itf_filter
 {
 public:
-    bgr2gray_filter(const string& name) : itf_filter(name)
+    threshold_filter(const string& name) : itf_filter(name)
     {
-        op_ = 0;
-        threshold1_ = 128;
-        threshold2_ = 128;
-        createTrackbar("threshold 1", name_, &threshold1_, 255, itf_filter::update_, this);
-        createTrackbar("threshold 2", name_, &threshold2_, 255, itf_filter::update_, this);
-        createTrackbar("(full,range,<|>,&,^,|,&~)", name_, &op_, 6, itf_filter::update_, this);
+        threshval_ = 128;
+        add_trackbar("threshval", &threshval_, 255);
     }
 protected:
     virtual Mat _filter(Mat& image)
     {
-        Mat res;
-        Mat mask;
-        cvtColor(image, res, CV_BGR2GRAY);
-        switch (op_)
-        {
-        case 1:
-            inRange(res, Scalar(min(threshold1_, threshold2_)), Scalar(max(threshold1_, threshold2_)), mask);
-            bitwise_and(mask, res, res);
-            break;
-        case 2:
-            inRange(res, Scalar(min(threshold1_, threshold2_)), Scalar(max(threshold1_, threshold2_)), mask);
-            bitwise_and(~mask, res, res);
-            break;
-        case 3: res = res & threshold1_; break;
-        case 4: res = res ^ threshold1_; break;
-        case 5: res = res | threshold1_; break;
-        case 6: res = res & (~threshold1_ & 0xff); break;
-        }
-        imshow(name_, res);
-        return res;
+        Mat bw = threshval_ < 128 ? (image < threshval_) : (image > threshval_);
+        display(bw);
+        return bw;
     }
-    int op_;
-    int threshold1_, threshold2_;
+    virtual bool lut_(int type, Mat& table, bool& head)
+    {
+        if (CV_MAT_DEPTH(type) != CV_8U)
+            return false;
+        Mat ramp = ramp_();
+        table = threshval_ < 128 ? (ramp < threshval_) : (ramp > threshval_);
+        head = false;
+        return true;
+    }
+    int threshval_;
 };
 
-class gray2mask_filter : public itf_filter
+class Canny_filter : public itf_filter
 {
 public:
-    gray2mask_filter(const string& name) : itf_filter(name)
+    Canny_filter(const string& name) : itf_filter(name)
     {
-        op_ = 0;
-        threshold_ = 128;
-        createTrackbar("threshold", name_, &threshold_, 255, itf_filter::update_, this);
-        createTrackbar("(full,==,!=,<,>,<=,>=)", name_, &op_, 6, itf_filter::update_, this);
+        threshval1_ = 0;
+        threshval2_ = 50;
+        aperturesize_ = 5;
+        l2gradient_ = 0;
+        add_trackbar("threshval-1", &threshval1_, 255);
+        add_trackbar("threshval-2", &threshval2_, 255);
+        add_trackbar("aperture size |1", &aperturesize_, 7);
+        add_trackbar("L2 gradient (OFF/ON)", &l2gradient_, 1);
+        trackbar_min("aperture size |1", 3);
+        trackbar_max("aperture size |1", 7);
     }
 protected:
     virtual Mat _filter(Mat& image)
     {
-        Mat res = image;
-        switch (op_)
-        {
-        case 1: res = res == threshold_; break;
-        case 2: res = res != threshold_; break;
-        case 3: res = res < threshold_; break;
-        case 4: res = res > threshold_; break;
-        case 5: res = res <= threshold_; break;
-        case 6: res = res >= threshold_; break;
-        }
-        imshow(name_, res);
+        Mat& res = output_();
+        Canny(image, res, threshval1_, threshval2_, aperturesize_|1, l2gradient_);
+        display(res);
         return res;
     }
-    int op_;
-    int threshold_;
+    int threshval1_;
+    int threshval2_;
+    int aperturesize_;
+    int l2gradient_;
 };
 
-class range_filter : public itf_filter
+class HoughLines_filter : public itf_filter
 {
 public:
-    range_filter(const string& name) : itf_filter(name)
+    HoughLines_filter(const string& name) : itf_filter(name)
     {
-        h1_ = s1_ = v1_ = 0;
-        h2_ = s2_ = v2_ = 255;
-		method_ = inv_ = mask_only_ = 0;
-        createTrackbar("h1(b,h)", name_, &h1_, 255, itf_filter::update_, this);
-        createTrackbar("h2(b,h)", name_, &h2_, 255, itf_filter::update_, this);
-        createTrackbar("s1(g,l)", name_, &s1_, 255, itf_filter::update_, this);
-        createTrackbar("s2(g,l)", name_, &s2_, 255, itf_filter::update_, this);
-        createTrackbar("v1(r,s)", name_, &v1_, 255, itf_filter::update_, this);
-        createTrackbar("v2(r,s)", name_, &v2_, 255, itf_filter::update_, this);
-        createTrackbar("hsv,bgr,hls", name_, &method_, 2, itf_filter::update_, this);
-        createTrackbar("invert mask", name_, &inv_, 1, itf_filter::update_, this);
-		createTrackbar("mask/no mask/mask only", name_, &mask_only_, 2, itf_filter::update_, this);
+        rho_ = 10;
+        theta_ = 1;
+        threshval_ = 150;
+        add_trackbar("rho*.1", &rho_, 100);
+        add_trackbar("theta angle", &theta_, 180);
+        add_trackbar("threshval", &threshval_, 1000);
+        trackbar_min("theta angle", 1);
     }
 protected:
     virtual Mat _filter(Mat& image)
     {
-        Mat res;
-        Mat hsv, mask;
-        if (0 == method_)
-            cvtColor(image, hsv, CV_BGR2HSV);
-        else if (2 == method_)
-            cvtColor(image, hsv, CV_BGR2HLS);
-        else
-            hsv = image;
-        inRange(hsv,
-                Scalar(min(h1_, h2_), min(s1_, s2_), min(v1_, v2_)),
-                Scalar(max(h1_, h2_), max(s1_, s2_), max(v1_, v2_)),
-                mask);
-		if (mask_only_ == 2)
-			res = (inv_) ? ~mask : mask;
-		else if (mask_only_ == 0)
-			bitwise_and(image, image, res, (inv_) ? ~mask : mask);
-		else
-			res = hsv;
-        imshow(name_, res);
+        Mat res = image;
+        vector<Vec2f> lines;
+        HoughLines(image, lines, rho_*.1, theta_*(CV_PI/180), scaled(threshval_));
+        Mat origin = graph_->origin();
+        draw_([=](){
+            Mat show = origin.clone();
+            for( size_t i = 0; i < lines.size(); i++ )
+            {
+                float rho = lines[i][0], theta = lines[i][1];
+                Point pt1, pt2;
+                double a = cos(theta), b = sin(theta);
+                double x0 = a*rho, y0 = b*rho;
+                pt1.x = cvRound(x0 + 1000*(-b));
+                pt1.y = cvRound(y0 + 1000*(a));
+                pt2.x = cvRound(x0 - 1000*(-b));
+                pt2.y = cvRound(y0 - 1000*(a));
+                line(show, pt1, pt2, Scalar(0,0,255), 2, LINE_AA);
+            }
+            return show;
+        });
         return res;
     }
-    int h1_, h2_, s1_, s2_, v1_, v2_;
-    int method_;
-    int inv_;
-	int mask_only_;
+    int rho_;
+    int theta_;
+    int threshval_;
 };
 
-class colormap_filter : public itf_filter
+class HoughLinesP_filter : public itf_filter
 {
 public:
-    colormap_filter(const string& name) : itf_filter(name)
+    HoughLinesP_filter(const string& name) : itf_filter(name)
     {
-        type_ = 0;
-        createTrackbar("type:\n"
-                       "AUTUMN=0, BONE, JET, WINTER, RAINBOW,\n"
-                       "OCEAN=5, SUMMER, SPRING, COOL, HSV,\n"
-                       "PINK=10, HOT, PARULA, MAGMA, INFERNO,\n"
-                       "PLASMA=15, VIRIDIS, CIVIDIS, TWILIGHT,\n"
-                       "TWILIGHT_SHIFTED=19, TURBO, DEEPGREEN", name_,
-                       &type_, 21, itf_filter::update_, this);
+        rho_ = 10;
+        theta_ = 1;
+        threshval_ = 50;
+        add_trackbar("rho*.1", &rho_, 100);
+        add_trackbar("theta angle", &theta_, 180);
+        add_trackbar("threshval", &threshval_, 1000);
+        trackbar_min("theta angle", 1);
     }
 protected:
     virtual Mat _filter(Mat& image)
     {
-        Mat res;
-        applyColorMap(image, res, type_);
-        imshow(name_, res);
+        Mat res = image;
+        vector<Vec4i> lines;
+        HoughLinesP(image, lines, rho_*.1, theta_*(CV_PI/180), scaled(threshval_), scaled(50), scaled(10));
+        Mat origin = graph_->origin();
+        draw_([=](){
+            Mat show = origin.clone();
+            for( size_t i = 0; i < lines.size(); i++ )
+            {
+                Vec4i l = lines[i];
+                line(show, Point(l[0], l[1]), Point(l[2], l[3]), Scalar(0,0,255), 2, LINE_AA);
+            }
+            return show;
+        });
         return res;
     }
-    int type_;
+    int rho_;
+    int theta_;
+    int threshval_;
 };
 
-/**
-feature
-    Feature2D is kind of Algorithm,
-        has two main functions, detect and compute.
-        1. detect corners KeyPoints
-        2. compute description Mat(rix).
-    A Feature2D backend may be detector or extractor or both.
-    SIFT, ORB, BRISK, KAZE, AKAZE, MSER.
-    FastFeatureDetector, AgastFeatureDetector, GFTTDetector, SimpleBlobDetector.
-    AffineFeature implementing the wrapper which makes detectors and extractors to be affine invariant.
-**/
-class feature_filter : public itf_filter
+class HoughCircles_filter : public itf_filter
 {
 public:
-    feature_filter(const string& name) : itf_filter(name)
+    HoughCircles_filter(const string& name) : itf_filter(name)
     {
-        curfeat_ = -1;
-        feature_ = 0;
-        affine_ = 1;
-        curaff_ = affine_;
-        limits_ = 0;
-        createTrackbar("feat count", name_, &limits_, INT_MAX, itf_filter::update_, this);
-        createTrackbar("feature:\nsift:0\norb:1\nbrisk:2\n"
-                       "kaze:3\nakaze:4\nmser:5\n"
-                       "fast:6\nagast:7\ngftt:8\nblob:9\n",
-                        name_, &feature_, 9, itf_filter::update_, this);
-        createTrackbar("Affine (OFF/ON)", name_, &affine_, 1, itf_filter::update_, this);
+        dist_ = 16;
+        radius1_ = 1;
+        radius2_ = 30;
+        add_trackbar("distance", &dist_, 32);
+        add_trackbar("radius (bound 1)", &radius1_, 100);
+        add_trackbar("radius (bound 2)", &radius2_, 100);
+        trackbar_min("radius (bound 1)", 1);
+        trackbar_min("radius (bound 2)", 1);
     }
 protected:
     virtual Mat _filter(Mat& image)
     {
         Mat res = image;
-
-        bool changed = feature_ != curfeat_ || affine_ != curaff_ ;
-        curaff_ = affine_;
-        if (feature_ != curfeat_)
-        {
-            
-			switch (feature_)
+        vector<Vec3f> circles;
+        HoughCircles(image, circles, HOUGH_GRADIENT, 1, image.rows/max(dist_, 1), 100, 30,
+                     scaled(min(radius1_, radius2_)), scaled(max(radius1_, radius2_)));
+        Mat origin = graph_->origin();
+        draw_([=](){
+            Mat show = origin.clone();
+            for( size_t i = 0; i < circles.size(); i++ )
             {
-            // both detector and extractor
-#ifdef NON_FREE
-            case 0: backend_ = SIFT::create(); break;
-            case 1: backend_ = ORB::create(); break;
-            case 2: backend_ = BRISK::create(); break;
-            case 3: backend_ = KAZE::create(); break;
-            case 4: backend_ = AKAZE::create(); break;
-            // just detector
-            case 5: backend_ = MSER::create(); break;
-            case 6: backend_ = FastFeatureDetector::create(); break;
-            case 7: backend_ = AgastFeatureDetector::create(); break;
-            case 8: backend_ = GFTTDetector::create(); break;
-            case 9: backend_ = SimpleBlobDetector::create(); break;
-#endif
-			}
-#ifdef NON_FREE
-            ext_ = AffineFeature::create(backend_);
-#endif
-            curfeat_ = feature_;
-        }
-
-
-        vector<KeyPoint> kp1;
-        Mat desc1;
-        Mat show = image.clone();
-        //ext_->detectAndCompute(image, Mat(), kp1, desc1);
-		if (affine_ && feature_ < 5)
-#ifdef NON_FREE
-			ext_->detect(image, kp1);
-#else
-			;
-#endif
-        else
-            backend_->detect(image, kp1);
-        setTrackbarMax("feat count", name_, kp1.size());
-        setTrackbarPos("feat count", name_, kp1.size());
-        if (changed)
-            limits_ = kp1.size();
-        next_color(true);
-        for_each(kp1.begin(), kp1.begin() + limits_,
-                 [&](KeyPoint& kp) {
-                    circle(show, kp.pt, 3, next_color());
-                 });
-        imshow(name_, show);
+                Vec3i c = circles[i];
+                Point center = Point(c[0], c[1]);
+                // circle center
+                circle(show, center, 1, Scalar(0,100,100), 1, LINE_AA);
+                // circle outline
+                int radius = c[2];
+                circle(show, center, radius, Scalar(255,0,255), 1, LINE_AA);
+            }
+            return show;
+        });
         return res;
     }
-    int feature_;
-    int curfeat_;
-    int affine_;
-    int curaff_;
-    int limits_;
-    Ptr<Feature2D> backend_;
-#ifdef NON_FREE
-    Ptr<AffineFeature> ext_;
-#endif
+    int dist_;
+    int radius1_;
+    int radius2_;
 };
 
-class blob_filter : public itf_filter
+// erode/dilate by a (2r+1) square or cross at a cost per pixel that does
+// not grow with r, after van Herk and Gil-Werman: the running min/max of
+// blocks of 2r+1 from their start (g) and from their end (h) give the
+// min/max of any window as min(h[x], g[x+2r]). the square is a row pass
+// then a column pass, the cross the min/max of both on the input. the
+// border is ignored as in cv::erode/dilate, so the result is the same.
+class fast_morph
 {
 public:
-    blob_filter(const string& name) : itf_filter(name)
+    // 8 bit images, MORPH_RECT and MORPH_CROSS only, false otherwise.
+    static bool supports(const Mat& src, int shape)
     {
-#ifdef NON_FREE
-        SimpleBlobDetector::Params pDefaultBLOB;
-        pDefaultBLOB.thresholdStep = 10;
-        pDefaultBLOB.minThreshold = 10;
-        pDefaultBLOB.maxThreshold = 220;
-        pDefaultBLOB.minRepeatability = 2;
-        pDefaultBLOB.minDistBetweenBlobs = 10;
-        pDefaultBLOB.filterByColor = false;
-        pDefaultBLOB.blobColor = 0;
-        pDefaultBLOB.filterByArea = false;
-        pDefaultBLOB.minArea = 25;
-        pDefaultBLOB.maxArea = 5000;
-        pDefaultBLOB.filterByCircularity = false;
-        pDefaultBLOB.minCircularity = 0.9f;
-        pDefaultBLOB.maxCircularity = (float)1e37;
-        pDefaultBLOB.filterByInertia = false;
-        pDefaultBLOB.minInertiaRatio = 0.1f;
-        pDefaultBLOB.maxInertiaRatio = (float)1e37;
-        pDefaultBLOB.filterByConvexity = false;
-        pDefaultBLOB.minConvexity = 0.95f;
-        pDefaultBLOB.maxConvexity = (float)1e37;
-
-        // Param for first BLOB detector we want all
-        params_.push_back(pDefaultBLOB);
-        params_.back().filterByArea = true;
-        params_.back().minArea = 1;
-        params_.back().maxArea = 2900;
-        // Param for third BLOB detector we want only circular object
-        params_.push_back(pDefaultBLOB);
-        params_.back().filterByCircularity = true;
-        // Param for Fourth BLOB detector we want ratio inertia
-        params_.push_back(pDefaultBLOB);
-        params_.back().filterByInertia = true;
-        params_.back().minInertiaRatio = 0;
-        params_.back().maxInertiaRatio = (float)0.2;
-        // Param for fifth BLOB detector we want ratio inertia
-        params_.push_back(pDefaultBLOB);
-        params_.back().filterByConvexity = true;
-        params_.back().minConvexity = 0.;
-        params_.back().maxConvexity = (float)0.9;
-        // Param for six BLOB detector we want blob with gravity center color equal to 0
-        params_.push_back(pDefaultBLOB);
-        params_.back().filterByColor = true;
-        params_.back().blobColor = 0;
-#endif
-        curfeat_ = -1;
-        feature_ = 0;
-        affine_ = 1;
-        curaff_ = affine_;
-        limits_ = 0;
-        update_ = 1;
-        val1_ = val2_ = 500;
-        area1_ = 0;
-        area2_ = 2900;
-        color_ = 0;
-        bgorigin_ = 0;
-        createTrackbar("feat count", name_, &limits_, INT_MAX, itf_filter::update_, this);
-        createTrackbar("feature:\nArea:0\nCircularity:1\nInertia:2\n"
-                       "Convexity:3\nColor:4\n",
-                        name_, &feature_, 4, itf_filter::update_, this);
-        createTrackbar("area (bound 1)", name_, &area1_, 10000, itf_filter::update_, this);
-        createTrackbar("area (bound 2)", name_, &area2_, 10000, itf_filter::update_, this);
-        createTrackbar("val (bound 1)", name_, &val1_, 1000, itf_filter::update_, this);
-        createTrackbar("val (bound 2)", name_, &val2_, 1000, itf_filter::update_, this);
-        createTrackbar("color", name_, &color_, 255, itf_filter::update_, this);
-        createTrackbar("use origin (OFF/ON)", name_, &bgorigin_, 1, itf_filter::update_, this);
+        return src.depth() == CV_8U && src.dims == 2 && (shape == MORPH_RECT || shape == MORPH_CROSS);
     }
-protected:
-    Ptr<Feature2D> getBackend()
+    static void erode_dilate(const Mat& src, Mat& dst, bool dilate, int shape, int r)
     {
-        if (!backends_[feature_])
+        if (r <= 0)
         {
-#ifdef NON_FREE
-            backends_[feature_] = SimpleBlobDetector::create(params_[feature_]);
-#endif
-		}
-        else if (update_)
+            src.copyTo(dst);
+            return;
+        }
+        Mat tmp;
+        if (shape == MORPH_RECT)
         {
-            switch (feature_)
+            rows_(src, tmp, dilate, r);
+            cols_(tmp, dst, dilate, r);
+            return;
+        }
+        Mat v;
+        rows_(src, tmp, dilate, r);
+        cols_(src, v, dilate, r);
+        if (dilate)
+            cv::max(tmp, v, dst);
+        else
+            cv::min(tmp, v, dst);
+    }
+    // op of morphologyEx, from MORPH_ERODE to MORPH_BLACKHAT.
+    static void morphology(const Mat& src, Mat& dst, int op, int shape, int r)
+    {
+        Mat a, b;
+        switch (op)
+        {
+        case MORPH_ERODE:
+            erode_dilate(src, dst, false, shape, r);
+            break;
+        case MORPH_DILATE:
+            erode_dilate(src, dst, true, shape, r);
+            break;
+        case MORPH_OPEN:
+            erode_dilate(src, a, false, shape, r);
+            erode_dilate(a, dst, true, shape, r);
+            break;
+        case MORPH_CLOSE:
+            erode_dilate(src, a, true, shape, r);
+            erode_dilate(a, dst, false, shape, r);
+            break;
+        case MORPH_GRADIENT:
+            erode_dilate(src, a, true, shape, r);
+            erode_dilate(src, b, false, shape, r);
+            subtract(a, b, dst);
+            break;
+        case MORPH_TOPHAT:
+            erode_dilate(src, a, false, shape, r);
+            erode_dilate(a, b, true, shape, r);
+            subtract(src, b, dst);
+            break;
+        case MORPH_BLACKHAT:
+            erode_dilate(src, a, true, shape, r);
+            erode_dilate(a, b, false, shape, r);
+            subtract(b, src, dst);
+            break;
+        }
+    }
+protected:
+    static inline uchar op_(bool dilate, uchar a, uchar b)
+    {
+        return dilate ? (a > b ? a : b) : (a < b ? a : b);
+    }
+    // windows along each row, channels kept apart.
+    static void rows_(const Mat& src, Mat& dst, bool dilate, int r)
+    {
+        dst.create(src.size(), src.type());
+        int cn = src.channels();
+        int k = 2 * r + 1;
+        int n = src.cols + 2 * r;
+        uchar id = dilate ? 0 : 255;
+        parallel_for_(Range(0, src.rows), [&](const Range& range) {
+            vector<uchar> pad(n * cn), g(n * cn), h(n * cn);
+            for (int y = range.start; y < range.end; ++y)
             {
-            case 0:
-                {
-                    SimpleBlobDetector::Params& param = params_[feature_];
-                    param.minArea = min(area1_, area2_);
-                    param.maxArea = max(area1_, area2_);
-                }
-                break;
-            case 1:
+                memset(&pad[0], id, r * cn);
+                memcpy(&pad[r * cn], src.ptr(y), src.cols * cn);
+                memset(&pad[(r + src.cols) * cn], id, r * cn);
+                for (int i = 0; i < n; ++i)
                 {
-                    // bug if val1 >= .9, val2 should not be [.9, 1.)
-                    SimpleBlobDetector::Params& param = params_[feature_];
-                    param.minCircularity = .001*min(val1_, val2_);
-                    param.maxCircularity = .001*max(val1_, val2_);
+                    const uchar* p = &pad[i * cn];
+                    uchar* gi = &g[i * cn];
+                    if (i % k == 0)
+                        memcpy(gi, p, cn);
+                    else
+                        for (int c = 0; c < cn; ++c)
+                            gi[c] = op_(dilate, gi[c - cn], p[c]);
                 }
-                break;
-            case 2:
+                for (int i = n - 1; i >= 0; --i)
                 {
-                    SimpleBlobDetector::Params& param = params_[feature_];
-                    param.minInertiaRatio = .001*min(val1_, val2_);
-                    param.maxInertiaRatio = .001*max(val1_, val2_);
+                    const uchar* p = &pad[i * cn];
+                    uchar* hi = &h[i * cn];
+                    if (i % k == k - 1 || i == n - 1)
+                        memcpy(hi, p, cn);
+                    else
+                        for (int c = 0; c < cn; ++c)
+                            hi[c] = op_(dilate, hi[c + cn], p[c]);
                 }
-                break;
-            case 3:
+                uchar* d = dst.ptr(y);
+                const uchar* hp = &h[0];
+                const uchar* gp = &g[(k - 1) * cn];
+                for (int j = 0; j < src.cols * cn; ++j)
+                    d[j] = op_(dilate, hp[j], gp[j]);
+            }
+        });
+    }
+    // windows along each column, on strips of columns; a whole row of a
+    // strip is one step, so the loops run along memory.
+    static void cols_(const Mat& src, Mat& dst, bool dilate, int r)
+    {
+        dst.create(src.size(), src.type());
+        int w = src.cols * src.channels();
+        int k = 2 * r + 1;
+        int n = src.rows + 2 * r;
+        const int strip = 256;
+        uchar id = dilate ? 0 : 255;
+        parallel_for_(Range(0, (w + strip - 1) / strip), [&](const Range& range) {
+            vector<uchar> idrow(strip, id), h((size_t)n * strip), g(strip);
+            for (int s = range.start; s < range.end; ++s)
+            {
+                int x0 = s * strip;
+                int sw = min(strip, w - x0);
+                // rows outside the image are the identity, as the border.
+                #define FAST_MORPH_ROW(i) (((i) < r || (i) >= src.rows + r) ? &idrow[0] : src.ptr((i) - r) + x0)
+                for (int i = n - 1; i >= 0; --i)
                 {
-                    SimpleBlobDetector::Params& param = params_[feature_];
-                    param.minConvexity = .001*min(val1_, val2_);
-                    param.maxConvexity = .001*max(val1_, val2_);
+                    const uchar* p = FAST_MORPH_ROW(i);
+                    uchar* hi = &h[(size_t)i * strip];
+                    if (i % k == k - 1 || i == n - 1)
+                        memcpy(hi, p, sw);
+                    else
+                    {
+                        const uchar* hn = hi + strip;
+                        for (int j = 0; j < sw; ++j)
+                            hi[j] = op_(dilate, hn[j], p[j]);
+                    }
                 }
-                break;
-            case 4:
+                // g runs forward in one row, window y is [y, y + k - 1].
+                for (int i = 0; i < n; ++i)
                 {
-                    SimpleBlobDetector::Params& param = params_[feature_];
-                    param.blobColor = color_;
+                    const uchar* p = FAST_MORPH_ROW(i);
+                    if (i % k == 0)
+                        memcpy(&g[0], p, sw);
+                    else
+                        for (int j = 0; j < sw; ++j)
+                            g[j] = op_(dilate, g[j], p[j]);
+                    int y = i - (k - 1);
+                    if (y < 0)
+                        continue;
+                    uchar* d = dst.ptr(y) + x0;
+                    const uchar* hy = &h[(size_t)y * strip];
+                    for (int j = 0; j < sw; ++j)
+                        d[j] = op_(dilate, hy[j], g[j]);
                 }
-                break;
+                #undef FAST_MORPH_ROW
             }
-#ifdef NON_FREE
-            backends_[feature_] = SimpleBlobDetector::create(params_[feature_]);
-#endif
-		}
-        return backends_[feature_];
-    }
-    virtual Mat _filter(Mat& image)
-    {
-        Mat res = image;
-
-        bool changed = feature_ != curfeat_ || affine_ != curaff_ ;
-        curaff_ = affine_;
-        if (changed)
-        {
-           switch (feature_)
-           {
-           case 0:
-               {
-               }
-               break;
-           case 1:
-               {
-                    setTrackbarPos("val (bound 1)", name_, params_[feature_].minCircularity*1000);
-                    setTrackbarPos("val (bound 2)", name_, params_[feature_].maxCircularity*1000);
-               }
-               break;
-           case 2:
-               {
-                    setTrackbarPos("val (bound 1)", name_, params_[feature_].minInertiaRatio*1000);
-                    setTrackbarPos("val (bound 2)", name_, params_[feature_].maxInertiaRatio*1000);
-               }
-               break;
-           case 3:
-               {
-                    setTrackbarPos("val (bound 1)", name_, params_[feature_].minConvexity*1000);
-                    setTrackbarPos("val (bound 2)", name_, params_[feature_].maxConvexity*1000);
-               }
-               break;
-           case 4:
-               {
-               }
-               break;
-           }
-        }
-        Ptr<Feature2D> backend = getBackend();
-
-
-        vector<KeyPoint> kp1;
-        Mat desc1;
-        Mat src = (bgorigin_)? graph_->origin() : image;
-        Mat show = (bgorigin_)? graph_->origin().clone() : image.clone();
-        backend->detect(image, kp1);
-        setTrackbarMax("feat count", name_, kp1.size());
-        setTrackbarPos("feat count", name_, kp1.size());
-        if (changed)
-            limits_ = kp1.size();
-#ifdef NON_FREE
-        drawKeypoints(src, kp1, show);
-#endif
-        next_color(true);
-        if (limits_)
-            for_each(kp1.begin(), kp1.begin() + limits_,
-                     [&](KeyPoint& kp) {
-                        circle(show, kp.pt, kp.size, next_color());
-                     });
-        imshow(name_, show);
-        return res;
+        });
     }
-    int feature_;
-    int curfeat_;
-    int affine_;
-    int curaff_;
-    int limits_;
-    int update_;
-    int area1_, area2_;
-    int val1_, val2_;
-    int color_;
-    int bgorigin_;
-    map<int, Ptr<Feature2D> > backends_;
-    vector<SimpleBlobDetector::Params> params_;
 };
 
-// opencv/samples/cpp/digits.cpp
-class deskew_filter : public itf_filter
+class morphology_filter : public itf_filter
 {
 public:
-    deskew_filter(const string& name) : itf_filter(name)
+    morphology_filter(const string& name) : itf_filter(name)
     {
-        sz_ = 20;
-        createTrackbar("size", name_, &sz_, 10000, itf_filter::update_, this);
+        method_ = 0;
+        threshval_ = 0;
+        shape_ = 0;
+        kernel_ = 1;
+        add_trackbar("morphology", &threshval_, 20);
+        trackbar_min("morphology", -10);
+        trackbar_max("morphology", 10);
+        //trackbar_pos("morphology", 0);
+        add_trackbar("method:\n0-open\n1-close\n2-erode\n3-dilate\n4-gradient\n5-tophat\n6-blackhat", &method_, 6);
+        add_trackbar("rect/ellipse/cross", &shape_, 2);
+        add_trackbar("kernel(OFF/ON)", &kernel_, 1);
+        fast_ = 0;
+        add_trackbar("van Herk(OFF/ON)", &fast_, 1);
+        element_shape_ = -1;
+        element_r_ = -1;
+        r_ = 0;
+        shape_id_ = MORPH_RECT;
+        fused_ = 0;
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    // rows above and below a pixel its output depends on.
+    int halo() const
     {
-        Mat res;
-        if (!image.empty())
-            setTrackbarMax("size", name_, max(image.cols, image.rows));
-        sz_ = max(1, sz_);
-        Moments m = moments(image);
-        if (abs(m.mu02) < 0.01)
+        int r = kernel_ ? r_ : 1;
+        switch (method_)
         {
-            res = image.clone();
+        case 0: case 1: case 5: case 6:
+            return 2 * r;
+        default:
+            return r;
         }
-        else
+    }
+protected:
+    friend class filter_graph;
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        prepare_();
+        if (fused_)
         {
-            float skew = (float)(m.mu11 / m.mu02);
-            float M_vals[2][3] = {{1, skew, -0.5f * sz_ * skew}, {0, 1, 0}};
-            Mat M(Size(3, 2), CV_32F);
-
-            for (int i = 0; i < M.rows; i++)
-            {
-                for (int j = 0; j < M.cols; j++)
-                {
-                    M.at<float>(i, j) = M_vals[i][j];
-                }
-            }
-
-            warpAffine(image, res, M, Size(sz_, sz_), WARP_INVERSE_MAP | INTER_LINEAR);
+            fused_->prepare_();
+            fuse_(*fused_, image, res);
+            fused_ = 0;
         }
-        imshow(name_, res);
+        else
+            morph_(image, res);
+        display(res);
         return res;
     }
-    int sz_;
-};
-
-// op
-class cut_filter : public itf_filter
-{
-public:
-    cut_filter(const string& name) : itf_filter(name)
-    {
-        use_save_ = true;
-        state_ = cut_IDLE;
-        setMouseCallback(name_, on_mouse, this);
-    }
-	cut_filter(const string& name, const string& comment) : itf_filter(name, comment)
-	{
-		use_save_ = true;
-		state_ = cut_IDLE;
-		setMouseCallback(name_, on_mouse, this);
-	}
-    cut_filter& apply(function<void(Mat,Mat)> f)
-    {
-        apply_ = f;
-        return *this;
-    }
-protected:
-    static void on_mouse(int event, int x, int y, int flags, void* ctx)
+    // the radius at the current scale and its element, on the thread
+    // of the graph; morph_ only reads them and may run on several.
+    void prepare_()
     {
-        ((cut_filter*)ctx)->_on_mouse(event, x, y, flags, ctx);
+        int an = abs(threshval_);
+        if (an)
+            an = max(1, scaled(an));
+        r_ = an;
+        static const int shapes[] = { MORPH_RECT, MORPH_ELLIPSE, MORPH_CROSS };
+        int shape = shapes[min(max(shape_, 0), 2)];
+        shape_id_ = shape;
+        // built again only when the shape or the size moved.
+        if (kernel_ && (element_shape_ != shape || element_r_ != an))
+        {
+            element_ = getStructuringElement(shape, Size(an*2+1, an*2+1), Point(an, an));
+            element_shape_ = shape;
+            element_r_ = an;
+        }
     }
-    virtual void _on_mouse(int event, int x, int y, int flags, void* ctx)
+    void morph_(const Mat& image, Mat& res) const
     {
-        ostringstream os;
-        switch (event)
+        static const int ops[] = { MORPH_OPEN, MORPH_CLOSE, MORPH_ERODE, MORPH_DILATE,
+                                   MORPH_GRADIENT, MORPH_TOPHAT, MORPH_BLACKHAT };
+        // without a kernel cv:: takes a 3x3 square.
+        int fast_shape = kernel_ ? shape_id_ : MORPH_RECT;
+        int fast_r = kernel_ ? r_ : 1;
+        if (fast_ && method_ >= 0 && method_ <= 6 && fast_morph::supports(image, fast_shape))
         {
-#ifdef HAVE_QT
-		case EVENT_MBUTTONDBLCLK:
-#else
-		case EVENT_RBUTTONDBLCLK:
-#endif
-            if (cut_FIN == state_)
-            {
-                Mat dst;
-                cutrect_ = rect_;
-                curve_(cutrect_).copyTo(dst);
-                os << "cut_"
-                         << rect_.x << "_"
-                         << rect_.y << "_"
-                         << rect_.width << "_"
-                         << rect_.height;
-                if (EVENT_FLAG_CTRLKEY & flags)
-                    os << ".bmp";
-                else if (EVENT_FLAG_SHIFTKEY & flags)
-                    os << ".jpg";
-                else
-                    os << ".png";
-                if (use_save_)
-                    imwrite(os.str(), dst);
-                if (apply_)
-                {
-                    cut_ = dst;
-                    apply_(curve_, cut_);
-                }
-            }
-            state_ = cut_SAVE;
+            fast_morph::morphology(image, res, ops[method_], fast_shape, fast_r);
+            return;
+        }
+        Mat element = kernel_ ? element_ : Mat();
+        switch (method_)
+        {
+        case 0:
+            morphologyEx(image, res, MORPH_OPEN, element);
             break;
-        case EVENT_LBUTTONDOWN:
-            state_ = cut_EDIT;
-            rect_.x = max(0, x);
-            rect_.y = max(0, y);
+        case 1:
+            morphologyEx(image, res, MORPH_CLOSE, element);
             break;
-        case EVENT_MOUSEMOVE:
-            if (cut_EDIT == state_)
-            {
-                rect_.width = max(0, x) - rect_.x;
-                rect_.height = max(0, y) - rect_.y;
-            }
+        case 2:
+            erode(image, res, element);
             break;
-        case EVENT_LBUTTONUP:
-            if (cut_EDIT == state_)
+        case 3:
+            dilate(image, res, element);
+            break;
+        case 4:
+            morphologyEx(image, res, MORPH_GRADIENT, element);
+            break;
+        case 5:
+            morphologyEx(image, res, MORPH_TOPHAT, element);
+            break;
+        case 6:
+            morphologyEx(image, res, MORPH_BLACKHAT, element);
+            break;
+        //case 7: // src.type() == CV_8UC1
+         //   morphologyEx(image, res, MORPH_HITMISS, element);
+          //  break;
+        }
+    }
+    // first then this one, band by band: each band of the output takes
+    // the rows of first's output it depends on, and those the rows of
+    // the input, so both intermediates of a band stay in cache. the rows
+    // a band computes past its halo are cut off, the result is the same
+    // as the two filters one after the other.
+    void fuse_(const morphology_filter& first, const Mat& image, Mat& res) const
+    {
+        int h1 = first.halo(), h2 = halo();
+        int rows = image.rows;
+        size_t row_bytes = max((size_t)1, image.cols * image.elemSize());
+        // a band redoes 2 * (h1 + h2) rows of first and 2 * h2 of this,
+        // at four times that tall they cost at most half again.
+        int band = max(max(8, 4 * (h1 + h2)), (int)((256 << 10) / row_bytes));
+        int bands = (rows + band - 1) / band;
+        res.create(image.size(), image.type());
+        parallel_for_(Range(0, bands), [&](const Range& range) {
+            Mat mid, out;
+            for (int k = range.start; k < range.end; ++k)
             {
-                if (0 == rect_.width)
-                    rect_.width = 4;
-                if (0 == rect_.height)
-                    rect_.height = 4;
-                if (rect_.width < 0)
-                {
-                    rect_.x += rect_.width;
-                    rect_.width -= rect_.width + rect_.width;
-                }
-                if (rect_.height < 0)
-                {
-                    rect_.y += rect_.height;
-                    rect_.height -= rect_.height + rect_.height;
-                }
-                if (rect_.y + rect_.height > curve_.rows)
-                {
-                    rect_.height = curve_.rows - rect_.y;
-                }
-                if (rect_.x + rect_.width > curve_.cols)
-                {
-                    rect_.width = curve_.cols - rect_.x;
-                }
-                state_ = cut_FIN;
+                int y0 = k * band, y1 = min(rows, y0 + band);
+                int s0 = max(0, y0 - h1 - h2), s1 = min(rows, y1 + h1 + h2);
+                int m0 = max(0, y0 - h2), m1 = min(rows, y1 + h2);
+                first.morph_(image.rowRange(s0, s1), mid);
+                morph_(mid.rowRange(m0 - s0, m1 - s0), out);
+                out.rowRange(y0 - m0, y1 - m0).copyTo(res.rowRange(y0, y1));
             }
+        });
+    }
+    int threshval_;
+    int method_;
+    int shape_;
+    int kernel_;
+    int fast_;
+    Mat element_;
+    int element_shape_;
+    int element_r_;
+    int r_;
+    int shape_id_;
+    // set by filter_graph for one call, runs fused_ first.
+    morphology_filter* fused_;
+};
+
+inline bool filter_graph::hidden_(size_t i)
+{
+    itf_filter* f = filters_[i].get();
+    if (!f->display_set_)
+        f->begin_display_();
+    // decided for its filter() call, if it is called.
+    f->display_set_ = true;
+    return !f->visible();
+}
+
+inline void filter_graph::skip_(size_t i)
+{
+    filters_[i]->display_set_ = false;
+    filters_[i]->shown_ = Mat();
+    filters_[i]->pend_(nullptr, true);
+}
+
+inline size_t filter_graph::fuse_(size_t i, const Mat& image)
+{
+    if (!fusion_ || recorder_ || i + 1 >= filters_.size())
+        return i;
+    size_t last = fuse_morph_(i);
+    if (last == i)
+        last = fuse_points_(i, image);
+    return last;
+}
+
+// two morphology filters in a row run as one banded pass, unless the
+// window of the first is drawn or its output tapped.
+inline size_t filter_graph::fuse_morph_(size_t i)
+{
+    morphology_filter* a = dynamic_cast<morphology_filter*>(filters_[i].get());
+    morphology_filter* b = dynamic_cast<morphology_filter*>(filters_[i + 1].get());
+    if (!a || !b || taps_[i] || !hidden_(i))
+        return i;
+    skip_(i);
+    b->fused_ = a;
+    return i + 1;
+}
+
+// a run of point ops from stage i, composed into one table while the
+// window of each but the last is left alone; the last applies it.
+inline size_t filter_graph::fuse_points_(size_t i, const Mat& image)
+{
+    if (image.empty() || image.depth() != CV_8U)
+        return i;
+    Mat table;
+    bool head = false;
+    if (!filters_[i]->lut_(image.type(), table, head))
+        return i;
+    int type = table.channels() == 3 ? CV_8UC3 : head ? CV_8UC1 : image.type();
+    size_t k = i + 1;
+    for (; k < filters_.size(); ++k)
+    {
+        Mat next;
+        bool h = false;
+        if (!filters_[k]->lut_(type, next, h) || h)
             break;
+        if (taps_[k - 1] || !hidden_(k - 1))
+            break;
+        if (next.channels() == 1)
+            LUT(table, next, table);
+        else
+        {
+            // one channel made BGR, as colormap.
+            Mat bgr(1, 256, CV_8UC3);
+            for (int v = 0; v < 256; ++v)
+                bgr.at<Vec3b>(v) = next.at<Vec3b>(table.at<uchar>(v));
+            table = bgr;
+            type = CV_8UC3;
         }
-
-        if (state_ > cut_IDLE)
+    }
+    if (k - i < 2)
+        return i;
+    size_t last = k - 1;
+    for (size_t j = i; j < last; ++j)
+        skip_(j);
+    itf_filter* first = filters_[i].get();
+    filters_[last]->replace_ = [first, head, table](const Mat& src, Mat& dst) {
+        Mat in = src;
+        if (head)
         {
-            Mat show;
-            curve_.copyTo(show);
-            if (state_ < cut_RESET)
-                rectangle(show, Point( rect_.x, rect_.y ), Point(rect_.x + rect_.width, rect_.y + rect_.height ), Scalar(0, 255, 0), 1);
-            else
+            // one channel tables go in place on the head.
+            if (table.channels() == 1)
             {
-                if (cut_SAVE == state_)
-                {
-                    rectangle(show, Point( cutrect_.x, cutrect_.y ), Point(cutrect_.x + cutrect_.width, cutrect_.y + cutrect_.height ), Scalar(0, 0, 255), 1);
-                    putText(show, (os << " saved!", os).str(), Point(0, 20), cv::FONT_HERSHEY_DUPLEX, 1.0, CV_RGB(118, 185, 0));
-                }
-                state_ = cut_IDLE;
+                first->lut_head_(src, dst);
+                LUT(dst, table, dst);
+                return;
             }
-            imshow(name_, show);
+            Mat one;
+            first->lut_head_(src, one);
+            in = one;
         }
-    }
-    virtual Mat _filter(Mat& image)
+        apply_lut_(in, table, dst);
+    };
+    return last;
+}
+
+// table of one channel on every channel, or of three on one channel.
+inline void filter_graph::apply_lut_(const Mat& src, const Mat& table, Mat& dst)
+{
+    if (table.channels() == 1 || table.channels() == src.channels())
     {
-        curve_ = image;
-        state_ = cut_IDLE;
-        //rect_ = Rect();
-        if (cutrect_.empty())
-            imshow(name_, curve_);
-        else
+        LUT(src, table, dst);
+        return;
+    }
+    dst.create(src.size(), CV_8UC3);
+    const Vec3b* t = table.ptr<Vec3b>();
+    parallel_for_(Range(0, src.rows), [&](const Range& range) {
+        for (int y = range.start; y < range.end; ++y)
         {
-            Mat show;
-            curve_.copyTo(show);
-            rectangle(show, Point(cutrect_.x, cutrect_.y ), Point(cutrect_.x + cutrect_.width, cutrect_.y + cutrect_.height ), Scalar(0, 0, 255), 1);
-            imshow(name_, show);
+            const uchar* s = src.ptr(y);
+            Vec3b* d = dst.ptr<Vec3b>(y);
+            for (int x = 0; x < src.cols; ++x)
+                d[x] = t[s[x]];
         }
-        if (apply_)
-            apply_(image, cut_);
-        return image;
-    }
-    Rect fullrect_;
-    Rect rect_;
-    Rect cutrect_;
-    enum {
-        cut_IDLE,
-        cut_EDIT,
-        cut_FIN,
-        cut_RESET,
-        cut_SAVE,
-    } state_;
-    Mat curve_;
-    Mat cut_;
-    bool use_save_;
-    function<void(Mat,Mat)> apply_;
-};
+    });
+}
 
-// cut2
-// generate pos/$time.jpg and neg/$time.jpg
-// append info to pos/pos.txt and neg/neg.txt
-class cut2_filter : public itf_filter
+class medianBlur_filter : public itf_filter
 {
 public:
-    cut2_filter(const string& name) : itf_filter(name)
+    medianBlur_filter(const string& name) : itf_filter(name)
     {
-        use_save_ = true;
-        state_ = cut_IDLE;
-        setMouseCallback(name_, on_mouse, this);
+        ksize_ = 1;
+        add_trackbar("ksize|1", &ksize_, 11);
     }
 protected:
-    static void on_mouse(int event, int x, int y, int flags, void* ctx)
+    virtual Mat _filter(Mat& image)
     {
-        ((cut2_filter*)ctx)->_on_mouse(event, x, y, flags, ctx);
+        Mat& res = output_();
+        medianBlur(image, res, scaled_ksize(ksize_));
+        display(res);
+        return res;
     }
-    void save_pos(const string& name)
+    int ksize_;
+};
+
+class GaussianBlur_filter : public itf_filter
+{
+public:
+    GaussianBlur_filter(const string& name) : itf_filter(name)
     {
-#ifdef HAVE_WIN32UI
-		_wmkdir(L"pos/");
-#endif
-        imwrite("pos/" + name, curve_);
-        ofstream fout;
-        fout.open("pos/pos.txt", ios_base::out|ios_base::app);
-        fout << "pos/" << name << " ";
-        fout << posrect_.size() << " ";
-        for_each(posrect_.begin(), posrect_.end(),
-                 [&](Rect& rect){
-                     fout << rect.x << " "
-                        << rect.y << " "
-                        << rect.width << " "
-                        << rect.height << " ";
-                 });
-        fout << "\n";
-        fout.close();
+        ksize_ = 1;
+        sigma_ = 1;
+        add_trackbar("ksize|1", &ksize_, 11);
+        add_trackbar("sigma*.5", &sigma_, 15);
     }
-    void save_neg(const string& name)
+protected:
+    virtual Mat _filter(Mat& image)
     {
-        Mat neg = curve_.clone();
-        Mat element = getStructuringElement(MORPH_RECT, Size(21, 21), Point(10, 10));
-        Mat morph;
-        morphologyEx(curve_, morph, MORPH_OPEN, element);
-        for_each(posrect_.begin(), posrect_.end(),
-                 [&](Rect& rect){
-                     //morph(rect).copyTo(neg(rect));
-                     ((Mat)Mat::zeros(rect.size(), neg.type())).copyTo(neg(rect));
-                 });
-#ifdef HAVE_WIN32UI
-		_wmkdir(L"neg/");
-#endif
-        imwrite("neg/" + name, neg);
-        ofstream fout;
-        fout.open("neg/neg.txt", ios_base::out|ios_base::app);
-        fout << "neg/" << name << "\n";
-        fout.close();
+        Mat& res = output_();
+        int k = scaled_ksize(ksize_);
+        GaussianBlur(image, res, Size(k, k), sigma_*.5*scale(), sigma_*.5*scale());
+        display(res);
+        return res;
     }
-    void _on_mouse(int event, int x, int y, int flags, void* ctx)
+    int ksize_;
+    int sigma_;
+};
+
+class bilateral_filter : public itf_filter
+{
+public:
+    bilateral_filter(const string& name) : itf_filter(name)
+    {
+        d_ = 5;
+        sigmaC_ = 100;
+        sigmaS_ = 100;
+        add_trackbar("d", &d_, 11);
+        add_trackbar("sigmaColor", &sigmaC_, 300);
+        add_trackbar("sigmaSpace", &sigmaS_, 300);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        bilateralFilter(image, res, d_ > 0 ? max(1, scaled(d_)) : d_, sigmaC_, sigmaS_*scale());
+        display(res);
+        return res;
+    }
+    int d_;
+    int sigmaC_;
+    int sigmaS_;
+};
+
+class box_filter : public itf_filter
+{
+public:
+    box_filter(const string& name) : itf_filter(name)
+    {
+        ddepth_ = 0;
+        ksize_ = 3;
+        add_trackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", &ddepth_, 7);
+        add_trackbar("ksize|1", &ksize_, 11);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        int k = scaled_ksize(ksize_);
+        boxFilter(image, res, ddepth_-1, Size(k, k));
+        display(res);
+        return res;
+    }
+    int ddepth_;
+    int ksize_;
+};
+
+class sqrBox_filter : public itf_filter
+{
+public:
+    sqrBox_filter(const string& name) : itf_filter(name)
+    {
+        ddepth_ = 0;
+        ksize_ = 3;
+        add_trackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", &ddepth_, 7);
+        add_trackbar("ksize|1", &ksize_, 11);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        int k = scaled_ksize(ksize_);
+        sqrBoxFilter(image, res, ddepth_-1, Size(k, k));
+        display(res);
+        return res;
+    }
+    int ddepth_;
+    int ksize_;
+};
+
+class blur_filter : public itf_filter
+{
+public:
+    blur_filter(const string& name) : itf_filter(name)
+    {
+        ksize_ = 3;
+        add_trackbar("ksize|1", &ksize_, 11);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        int k = scaled_ksize(ksize_);
+        blur(image, res, Size(k, k));
+        display(res);
+        return res;
+    }
+    int ksize_;
+};
+
+class filter2D_filter;
+class sepFilter2D_filter;
+
+class Sobel_filter : public itf_filter
+{
+public:
+    Sobel_filter(const string& name) : itf_filter(name)
+    {
+        dx_ = dy_ = 1;
+        ddepth_ = 0;
+        ksize_ = 3;
+        add_trackbar("dx", &dx_, 10);
+        trackbar_max("dx", max(((ksize_|1) - 1), 1));
+        add_trackbar("dy", &dy_, 10);
+        trackbar_max("dy", max(((ksize_|1) - 1), 1));
+        add_trackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", &ddepth_, 7);
+        add_trackbar("ksize|1", &ksize_, 11);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        trackbar_max("dx", max(((ksize_|1) - 1), 1));
+        trackbar_max("dy", max(((ksize_|1) - 1), 1));
+        if (dx_ == 0)
+            trackbar_min("dy", 1);
+        if (dy_ == 0)
+            trackbar_min("dx", 1);
+        if (dx_ && dy_)
+        {
+            trackbar_min("dy", 0);
+            trackbar_min("dx", 0);
+        }
+        Sobel(image, res, ddepth_-1, dx_, dy_, ksize_|1);
+        display(res);
+        return res;
+    }
+    int dx_;
+    int dy_;
+    int ddepth_;
+    int ksize_;
+};
+
+class Scharr_filter : public itf_filter
+{
+public:
+    Scharr_filter(const string& name) : itf_filter(name)
+    {
+        dx_ = dy_ = 0;
+        ddepth_ = 0;
+        add_trackbar("dx(0,1)", &dx_, 1);
+        //add_trackbar("dy*.01", &dy_, 1);
+        add_trackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", &ddepth_, 7);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        Scharr(image, res, ddepth_-1, dx_, 1 - dx_);
+        display(res);
+        return res;
+    }
+    int dx_;
+    int dy_;
+    int ddepth_;
+};
+
+class Laplacian_filter : public itf_filter
+{
+public:
+    Laplacian_filter(const string& name) : itf_filter(name)
+    {
+        ddepth_ = 0;
+        ksize_ = 3;
+        delta_ = 0;
+        add_trackbar("ddepth(-1,8U,8S,16U,16S,32S,32F)", &ddepth_, 7);
+        add_trackbar("ksize|1", &ksize_, 11);
+        add_trackbar("delta", &delta_, 11);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        Laplacian(image, res, (ddepth_)?ddepth_*8:-1, ksize_|1, 1, delta_);
+        display(res);
+        return res;
+    }
+    int ddepth_;
+    int ksize_;
+    int delta_;
+};
+
+class cornerMinEigenVal_filter : public itf_filter
+{
+public:
+    cornerMinEigenVal_filter(const string& name) : itf_filter(name)
+    {
+        blocksize_ = 3;
+        ksize_ = 7;
+        add_trackbar("block size", &blocksize_, 7);
+        trackbar_min("block size", 1);
+        add_trackbar("ksize|1", &ksize_, 11);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        Mat src;
+        if (!(image.type() == CV_8UC1 || image.type() == CV_32FC1))
+        {
+            cvtColor(image, src, CV_BGR2GRAY);
+        }
+        else
+        {
+            src = image;
+        }
+        cornerMinEigenVal(src, res, blocksize_, ksize_|1);
+        display(res);
+        return res;
+    }
+    int blocksize_;
+    int ksize_;
+};
+
+class cornerHarris_filter : public itf_filter
+{
+public:
+    cornerHarris_filter(const string& name) : itf_filter(name)
+    {
+        blocksize_ = 3;
+        ksize_ = 7;
+        k_ = 11;
+        add_trackbar("block size", &blocksize_, 7);
+        trackbar_min("block size", 1);
+        add_trackbar("ksize|1", &ksize_, 11);
+        add_trackbar("k*.25", &ksize_, 31);
+
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        Mat src;
+        if (!(image.type() == CV_8UC1 || image.type() == CV_32FC1))
+        {
+            cvtColor(image, src, CV_BGR2GRAY);
+        }
+        else
+        {
+            src = image;
+        }
+        cornerHarris(src, res, blocksize_, ksize_|1, k_*.25);
+        display(res);
+        return res;
+    }
+    int blocksize_;
+    int ksize_;
+    int k_;
+};
+
+class cornerEigenValsAndVecs_filter : public itf_filter
+{
+public:
+    cornerEigenValsAndVecs_filter(const string& name) : itf_filter(name)
+    {
+        blocksize_ = 3;
+        ksize_ = 7;
+        add_trackbar("block size", &blocksize_, 7);
+        trackbar_min("block size", 1);
+        add_trackbar("ksize|1", &ksize_, 11);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        Mat src;
+        if (!(image.type() == CV_8UC1 || image.type() == CV_32FC1))
+        {
+            cvtColor(image, src, CV_BGR2GRAY);
+        }
+        else
+        {
+            src = image;
+        }
+        cornerEigenValsAndVecs(src, res, blocksize_, ksize_|1);
+        display(res);
+        return res;
+    }
+    int blocksize_;
+    int ksize_;
+};
+
+class preCornerDetect_filter : public itf_filter
+{
+public:
+    preCornerDetect_filter(const string& name) : itf_filter(name)
+    {
+        ksize_ = 3;
+        threshold1_ = 0;
+        threshold2_ = 0;
+        add_trackbar("ksize|1", &ksize_, 11);
+        //add_trackbar("threshold*.001(bound 1)", &threshold1_, 1000);
+        //add_trackbar("threshold*.001(bound 2)", &threshold2_, 1000);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        preCornerDetect(image, res, ksize_|1);
+        double minV, maxV;
+        minMaxLoc(res, &minV, &maxV);
+        trackbar_min("threshold*.001(bound 1)", int(minV*1000));
+        trackbar_min("threshold*.001(bound 2)", int(minV*1000));
+        trackbar_max("threshold*.001(bound 1)", int(maxV*1000));
+        trackbar_max("threshold*.001(bound 2)", int(maxV*1000));
+        //Mat show = (res >= (min(threshold1_, threshold2_) / 1000.)) <= (max(threshold1_, threshold2_) / 1000.);
+        display(res);
+        return res;
+    }
+    int ksize_;
+    int threshold1_;
+    int threshold2_;
+};
+
+class norm_minmax_filter : public itf_filter
+{
+public:
+    norm_minmax_filter(const string& name) : itf_filter(name)
+    {
+        op_ = 0;
+        switch_ = 1;
+        threshold_ = 128;
+        add_trackbar("threshold*.001", &threshold_, 1000);
+        add_trackbar("(full,<,>,<=,>=)", &op_, 4);
+        add_trackbar("normalize (OFF/ON)", &op_, 1);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat res;
+        if (switch_)
+            normalize(image, res, 0, 1, NORM_MINMAX);
+        switch (op_)
+        {
+        case 1: res = res < threshold_*.001; break;
+        case 2: res = res > threshold_*.001; break;
+        case 3: res = res <= threshold_*.001; break;
+        case 4: res = res >= threshold_*.001; break;
+        }
+        display(res);
+        return res;
+    }
+    int threshold_;
+    int op_;
+    int switch_;
+};
+
+class warpAffine_filter;
+class warpAffine_filter : public itf_filter
+{
+public:
+    warpAffine_filter(const string& name) : itf_filter(name)
+    {
+        motion_ = 2;
+        size_ = 200;
+        add_trackbar("TRANSLATION/EUCLIDEAN/AFFINE", &motion_, 2);
+        add_trackbar("size", &size_, 8192);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        trackbar_max("size", cvRound(image.cols / scale()));
+        Mat& res = output_();
+        Mat warpGround;
+        RNG rng(getTickCount());
+        double angle;
+        switch (motion_)
+        {
+        case 0: //MOTION_TRANSLATION:
+            warpGround = (Mat_<float>(2,3) << 1, 0, (rng.uniform(10.f, 20.f)),
+                0, 1, (rng.uniform(10.f, 20.f)));
+            //warpAffine(image, res, warpGround,
+            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
+            break;
+        case 1: //MOTION_EUCLIDEAN:
+            angle = CV_PI/30 + CV_PI*rng.uniform((double)-2.f, (double)2.f)/180;
+
+            warpGround = (Mat_<float>(2,3) << cos(angle), -sin(angle), (rng.uniform(10.f, 20.f)),
+                sin(angle), cos(angle), (rng.uniform(10.f, 20.f)));
+            //warpAffine(image, res, warpGround,
+            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
+            break;
+        case 2: //MOTION_AFFINE:
+
+            warpGround = (Mat_<float>(2,3) << (1-rng.uniform(-0.05f, 0.05f)),
+                (rng.uniform(-0.03f, 0.03f)), (rng.uniform(10.f, 20.f)),
+                (rng.uniform(-0.03f, 0.03f)), (1-rng.uniform(-0.05f, 0.05f)),
+                (rng.uniform(10.f, 20.f)));
+            //warpAffine(image, res, warpGround,
+            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
+            break;
+        case 3: //MOTION_HOMOGRAPHY:
+            warpGround = (Mat_<float>(3,3) << (1-rng.uniform(-0.05f, 0.05f)),
+                (rng.uniform(-0.03f, 0.03f)), (rng.uniform(10.f, 20.f)),
+                (rng.uniform(-0.03f, 0.03f)), (1-rng.uniform(-0.05f, 0.05f)),(rng.uniform(10.f, 20.f)),
+                (rng.uniform(0.0001f, 0.0003f)), (rng.uniform(0.0001f, 0.0003f)), 1.f);
+            //warpPerspective(image, res, warpGround,
+            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
+            break;
+        }
+        warpAffine(image, res, warpGround, Size(scaled(size_), scaled(size_)), INTER_LINEAR + WARP_INVERSE_MAP);
+        display(res);
+        return res;
+    }
+    int motion_;
+    int size_;
+};
+class warpPerspective_filter;
+class warpPerspective_filter : public itf_filter
+{
+public:
+    warpPerspective_filter(const string& name) : itf_filter(name)
+    {
+        motion_ = 3;
+        size_ = 200;
+        add_trackbar("size", &size_, 8192);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        trackbar_max("size", cvRound(image.cols / scale()));
+        Mat& res = output_();
+        Mat warpGround;
+        RNG rng(getTickCount());
+        double angle;
+        switch (motion_)
+        {
+        case 3: //MOTION_HOMOGRAPHY:
+        default:
+            warpGround = (Mat_<float>(3,3) << (1-rng.uniform(-0.05f, 0.05f)),
+                (rng.uniform(-0.03f, 0.03f)), (rng.uniform(10.f, 20.f)),
+                (rng.uniform(-0.03f, 0.03f)), (1-rng.uniform(-0.05f, 0.05f)),(rng.uniform(10.f, 20.f)),
+                (rng.uniform(0.0001f, 0.0003f)), (rng.uniform(0.0001f, 0.0003f)), 1.f);
+            //warpPerspective(image, res, warpGround,
+            //    Size(200,200), INTER_LINEAR + WARP_INVERSE_MAP);
+            break;
+        }
+        warpPerspective(image, res, warpGround, Size(scaled(size_), scaled(size_)), INTER_LINEAR + WARP_INVERSE_MAP);
+        display(res);
+        return res;
+    }
+    int motion_;
+    int size_;
+};
+
+class remap_filter;
+
+class warpPolar_filter;
+class warpPolar_filter : public itf_filter
+{
+public:
+    warpPolar_filter(const string& name) : itf_filter(name)
+    {
+        x_ = 50;
+        y_ = 50;
+        radius_ = 70;
+        flag_ = 0;
+        inv_ = 0;
+        add_trackbar("x (0~100%)", &x_, 100);
+        add_trackbar("y (0~100%)", &y_, 100);
+        add_trackbar("radius (0~100%)", &radius_, 100);
+        add_trackbar("LINEAR/LOG", &flag_, 1);
+        add_trackbar("INVERSE (OFF/ON)", &inv_, 1);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        Point2f pt( (float)image.cols * x_ / 100., (float)image.rows * y_ / 100. );
+        double maxRadius = radius_ * min(pt.y, pt.x) / 100.;
+        int flags = ((flag_)? WARP_POLAR_LOG:WARP_POLAR_LINEAR)
+                    + ((inv_)?WARP_INVERSE_MAP:0);
+
+        warpPolar(image, res, Size(),pt, maxRadius, flags);
+
+        display(res);
+        return res;
+    }
+    int x_;
+    int y_;
+    int radius_;
+    int flag_;
+    int inv_;
+};
+
+class pyrDown_filter : public itf_filter
+{
+public:
+    pyrDown_filter(const string& name) : itf_filter(name)
+    {
+        x_ = 50;
+        y_ = 50;
+        add_trackbar("x (0~100%)", &x_, 100);
+        add_trackbar("y (0~100%)", &y_, 100);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        pyrDown(image, res, Size(image.cols * x_ / 100, (float)image.rows *x_ / 100.));
+        display(res);
+        return res;
+    }
+    int x_;
+    int y_;
+};
+
+class pyrUp_filter : public itf_filter
+{
+public:
+    pyrUp_filter(const string& name) : itf_filter(name)
+    {
+        x_ = 200;
+        y_ = 200;
+        add_trackbar("x (0~100%)", &x_, 200);
+        add_trackbar("y (0~100%)", &y_, 200);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        pyrUp(image, res, Size(image.cols * x_ / 100, (float)image.rows * x_ / 100.));
+        display(res);
+        return res;
+    }
+    int x_;
+    int y_;
+};
+
+// demonstrates
+class dem_filter : public itf_filter
+{
+public:
+    dem_filter(const string& name) : itf_filter(name)
+    {
+        brightness_ = 100;
+        contrast_ = 100;
+        add_trackbar("brightness-100", &brightness_, 200);
+        add_trackbar("contrast-100", &contrast_, 200);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        double a, b;
+        coeffs_(a, b);
+        image.convertTo(res, CV_8U, a, b);
+        display(res);
+        return res;
+    }
+    virtual bool lut_(int type, Mat& table, bool& head)
+    {
+        if (CV_MAT_DEPTH(type) != CV_8U)
+            return false;
+        double a, b;
+        coeffs_(a, b);
+        ramp_().convertTo(table, CV_8U, a, b);
+        head = false;
+        return true;
+    }
+    void coeffs_(double& a, double& b) const
+    {
+        int brightness = brightness_ - 100;
+        int contrast = contrast_ - 100;
+        /*
+         * The algorithm is by Werner D. Streidt
+         * (http://visca.com/ffactory/archives/5-99/msg00021.html)
+         */
+        if( contrast > 0 )
+        {
+            double delta = 127.*contrast/100;
+            a = 255./(255. - delta*2);
+            b = a*(brightness - delta);
+        }
+        else
+        {
+            double delta = -128.*contrast/100;
+            a = (256.-delta*2)/255.;
+            b = a*brightness + delta;
+        }
+    }
+    int brightness_;
+    int contrast_;
+};
+
+class distrans_filter : public itf_filter
+{
+public:
+    distrans_filter(const string& name) : itf_filter(name)
+    {
+        maskSize0_ = DIST_MASK_5;
+        voronoiType_ = -1;
+        edgeThresh_ = 100;
+        distType0_ = DIST_L1;
+        method_ = 0;
+        add_trackbar("Brightness Threshold", &edgeThresh_, 255);
+        add_trackbar("method:\n"
+            "0 - use C/Inf metric\n"
+            "1 - use L1 metric\n"
+            "2 - use L2 metric\n"
+            "3 - use 3x3 mask\n"
+            "4 - use 5x5 mask\n"
+            "5 - use precise distance transform\n"
+            "6 - switch to Voronoi diagram mode\n"
+            "7 - switch to pixel-based Voronoi diagram mode\n", &method_, 7);
+
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat gray = image;
+        Mat res;
+        if (method_ < 6)
+            voronoiType_ = -1;
+        switch (method_)
+        {
+        case 0: distType0_ = DIST_C; break;
+        case 1: distType0_ = DIST_L1; break;
+        case 2: distType0_ = DIST_L2; break;
+        case 3: maskSize0_ = DIST_MASK_3; break;
+        case 4: maskSize0_ = DIST_MASK_5; break;
+        case 5: maskSize0_ = DIST_MASK_PRECISE; break;
+        case 6: voronoiType_ = 0; break;
+        case 7: voronoiType_ = 1; break;
+        }
+
+        int maskSize = voronoiType_ >= 0 ? DIST_MASK_5 : maskSize0_;
+        int distType = voronoiType_ >= 0 ? DIST_L2 : distType0_;
+
+        Mat edge = gray >= edgeThresh_, dist, labels;
+        Mat& dist8u = output_();
+
+        if( voronoiType_ < 0 )
+        {
+            distanceTransform(edge, dist, distType, maskSize);
+            paint_(dist, dist8u);
+        }
+        else
+        {
+            distanceTransform(edge, dist, labels, distType, maskSize, voronoiType_);
+            paint_voronoi_(dist, labels, dist8u);
+        }
+        res = dist8u;
+        display(dist8u);
+        return res;
+    }
+    // blue = round(sqrt(dist*5000) + .5) & 255, green = red = 255 - blue,
+    // in one pass over blocks of rows, the same float steps as the
+    // *=, pow, convertTo, &=, *= -1, += and merge chain it replaces.
+    static void paint_(const Mat& dist, Mat& dist8u)
+    {
+        dist8u.create(dist.size(), CV_8UC3);
+        parallel_for_(Range(0, dist.rows), [&](const Range& range) {
+            for (int i = range.start; i < range.end; ++i)
+            {
+                const float* dd = dist.ptr<float>(i);
+                uchar* d = dist8u.ptr(i);
+                for (int j = 0; j < dist.cols; ++j)
+                {
+                    int v = cvRound(std::sqrt(dd[j] * 5000.f) + 0.5f) & 255;
+                    d[j*3] = (uchar)v;
+                    d[j*3+1] = (uchar)(255 - v);
+                    d[j*3+2] = (uchar)(255 - v);
+                }
+            }
+        });
+    }
+    // the color of the nearest zero pixel's label, fading with distance.
+    static void paint_voronoi_(const Mat& dist, const Mat& labels, Mat& dist8u)
+    {
+        static const double colors[][3] =
+        {
+            {0,0,0},
+            {255,0,0},
+            {255,128,0},
+            {255,255,0},
+            {0,255,0},
+            {0,128,255},
+            {0,255,255},
+            {0,0,255},
+            {255,0,255}
+        };
+        dist8u.create(labels.size(), CV_8UC3);
+        parallel_for_(Range(0, labels.rows), [&](const Range& range) {
+            for( int i = range.start; i < range.end; i++ )
+            {
+                const int* ll = labels.ptr<int>(i);
+                const float* dd = dist.ptr<float>(i);
+                uchar* d = dist8u.ptr(i);
+                for( int j = 0; j < labels.cols; j++ )
+                {
+                    if (ll[j] == 0 || dd[j] == 0)
+                    {
+                        d[j*3] = d[j*3+1] = d[j*3+2] = 0;
+                        continue;
+                    }
+                    const double* c = colors[((ll[j]-1) & 7) + 1];
+                    float scale = 1.f/(1 + dd[j]*dd[j]*0.0004f);
+                    d[j*3] = (uchar)cvRound(c[0]*scale);
+                    d[j*3+1] = (uchar)cvRound(c[1]*scale);
+                    d[j*3+2] = (uchar)cvRound(c[2]*scale);
+                }
+            }
+        });
+    }
+    int maskSize0_;
+    int voronoiType_;
+    int edgeThresh_;
+    int distType0_;
+    int method_;
+};
+
+// apply:
+// contours
+
+/**
+imgproc
+CV_EXPORTS_W void medianBlur( InputArray src, OutputArray dst, int ksize );
+CV_EXPORTS_W void GaussianBlur( InputArray src, OutputArray dst, Size ksize,
+CV_EXPORTS_W void bilateralFilter( InputArray src, OutputArray dst, int d,
+CV_EXPORTS_W void boxFilter( InputArray src, OutputArray dst, int ddepth,
+CV_EXPORTS_W void sqrBoxFilter( InputArray src, OutputArray dst, int ddepth,
+CV_EXPORTS_W void blur( InputArray src, OutputArray dst,
+CV_EXPORTS_W void filter2D( InputArray src, OutputArray dst, int ddepth,
+CV_EXPORTS_W void sepFilter2D( InputArray src, OutputArray dst, int ddepth,
+CV_EXPORTS_W void Sobel( InputArray src, OutputArray dst, int ddepth,
+CV_EXPORTS_W void Scharr( InputArray src, OutputArray dst, int ddepth,
+CV_EXPORTS_W void Laplacian( InputArray src, OutputArray dst, int ddepth,
+CV_EXPORTS_W void cornerMinEigenVal( InputArray src, OutputArray dst,
+CV_EXPORTS_W void cornerHarris( InputArray src, OutputArray dst, int blockSize,
+CV_EXPORTS_W void cornerEigenValsAndVecs( InputArray src, OutputArray dst,
+CV_EXPORTS_W void preCornerDetect( InputArray src, OutputArray dst, int ksize,
+CV_EXPORTS_W void erode( InputArray src, OutputArray dst, InputArray kernel,
+CV_EXPORTS_W void dilate( InputArray src, OutputArray dst, InputArray kernel,
+CV_EXPORTS_W void morphologyEx( InputArray src, OutputArray dst,
+CV_EXPORTS_W void resize( InputArray src, OutputArray dst,
+CV_EXPORTS_W void warpAffine( InputArray src, OutputArray dst,
+CV_EXPORTS_W void warpPerspective( InputArray src, OutputArray dst,
+CV_EXPORTS_W void remap( InputArray src, OutputArray dst,
+                               OutputArray dstmap1, OutputArray dstmap2,
+CV_EXPORTS_W void logPolar( InputArray src, OutputArray dst,
+CV_EXPORTS_W void linearPolar( InputArray src, OutputArray dst,
+CV_EXPORTS_W void warpPolar(InputArray src, OutputArray dst, Size dsize,
+CV_EXPORTS_W void accumulate( InputArray src, InputOutputArray dst,
+CV_EXPORTS_W void accumulateSquare( InputArray src, InputOutputArray dst,
+                                     InputOutputArray dst, InputArray mask=noArray() );
+CV_EXPORTS_W void accumulateWeighted( InputArray src, InputOutputArray dst,
+CV_EXPORTS_W void createHanningWindow(OutputArray dst, Size winSize, int type);
+CV_EXPORTS_W double threshold( InputArray src, OutputArray dst,
+CV_EXPORTS_W void adaptiveThreshold( InputArray src, OutputArray dst,
+CV_EXPORTS_W void pyrDown( InputArray src, OutputArray dst,
+CV_EXPORTS_W void pyrUp( InputArray src, OutputArray dst,
+CV_EXPORTS_W void undistort( InputArray src, OutputArray dst,
+CV_EXPORTS_W void undistortPoints( InputArray src, OutputArray dst,
+CV_EXPORTS_AS(undistortPointsIter) void undistortPoints( InputArray src, OutputArray dst,
+                                   InputArray hist, OutputArray dst,
+CV_EXPORTS_W void equalizeHist( InputArray src, OutputArray dst );
+CV_EXPORTS_W void pyrMeanShiftFiltering( InputArray src, OutputArray dst,
+CV_EXPORTS_AS(distanceTransformWithLabels) void distanceTransform( InputArray src, OutputArray dst,
+CV_EXPORTS_W void distanceTransform( InputArray src, OutputArray dst,
+CV_EXPORTS void blendLinear(InputArray src1, InputArray src2, InputArray weights1, InputArray weights2, OutputArray dst);
+CV_EXPORTS_W void cvtColor( InputArray src, OutputArray dst, int code, int dstCn = 0 );
+CV_EXPORTS_W void cvtColorTwoPlane( InputArray src1, InputArray src2, OutputArray dst, int code );
+CV_EXPORTS_W void demosaicing(InputArray src, OutputArray dst, int code, int dstCn = 0);
+CV_EXPORTS_W void applyColorMap(InputArray src, OutputArray dst, int colormap);
+CV_EXPORTS_W void applyColorMap(InputArray src, OutputArray dst, InputArray userColor);
+
+**/
+
+/**
+core
+
+**/
+// the (full,range,<|>,&,^,|,&~) trackbar of channel and bgr2gray.
+inline void gray_ops(Mat& res, int op, int threshold1, int threshold2)
+{
+    Mat mask;
+    switch (op)
+    {
+    case 1:
+        inRange(res, Scalar(min(threshold1, threshold2)), Scalar(max(threshold1, threshold2)), mask);
+        bitwise_and(mask, res, res);
+        break;
+    case 2:
+        inRange(res, Scalar(min(threshold1, threshold2)), Scalar(max(threshold1, threshold2)), mask);
+        bitwise_and(~mask, res, res);
+        break;
+    case 3: res = res & threshold1; break;
+    case 4: res = res ^ threshold1; break;
+    case 5: res = res | threshold1; break;
+    case 6: res = res & (~threshold1 & 0xff); break;
+    }
+}
+
+class channel_filter : public itf_filter
+{
+public:
+    channel_filter(const string& name) : itf_filter(name)
+    {
+        op_ = 0;
+        channel_ = 0;
+        threshold1_ = 128;
+        threshold2_ = 128;
+        add_trackbar("threshold 1", &threshold1_, 255);
+        add_trackbar("threshold 2", &threshold2_, 255);
+        add_trackbar("(full,range,<|>,&,^,|,&~)", &op_, 6);
+        add_trackbar("channel (0-3)", &channel_, 3);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat res(image.size(), CV_8U);
+        lut_head_(image, res);
+        gray_ops(res, op_, threshold1_, threshold2_);
+        display(res);
+        return res;
+    }
+    virtual bool lut_(int type, Mat& table, bool& head)
+    {
+        if (CV_MAT_DEPTH(type) != CV_8U)
+            return false;
+        table = ramp_();
+        gray_ops(table, op_, threshold1_, threshold2_);
+        head = true;
+        return true;
+    }
+    virtual void lut_head_(const Mat& image, Mat& res)
+    {
+        res.create(image.size(), CV_8U);
+        int ch[] = {std::min((image.type() >> CV_CN_SHIFT), channel_), 0};
+        mixChannels(&image, 1, &res, 1, ch, 1);
+    }
+    int op_;
+    int channel_;
+    int threshold1_, threshold2_;
+};
+
+class bgr2gray_filter : public itf_filter
+{
+public:
+    bgr2gray_filter(const string& name) : itf_filter(name)
+    {
+        op_ = 0;
+        threshold1_ = 128;
+        threshold2_ = 128;
+        add_trackbar("threshold 1", &threshold1_, 255);
+        add_trackbar("threshold 2", &threshold2_, 255);
+        add_trackbar("(full,range,<|>,&,^,|,&~)", &op_, 6);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        cvtColor(image, res, CV_BGR2GRAY);
+        gray_ops(res, op_, threshold1_, threshold2_);
+        display(res);
+        return res;
+    }
+    virtual bool lut_(int type, Mat& table, bool& head)
+    {
+        if (type != CV_8UC3 && type != CV_8UC4)
+            return false;
+        table = ramp_();
+        gray_ops(table, op_, threshold1_, threshold2_);
+        head = true;
+        return true;
+    }
+    virtual void lut_head_(const Mat& image, Mat& res)
+    {
+        cvtColor(image, res, CV_BGR2GRAY);
+    }
+    int op_;
+    int threshold1_, threshold2_;
+};
+
+class gray2mask_filter : public itf_filter
+{
+public:
+    gray2mask_filter(const string& name) : itf_filter(name)
+    {
+        op_ = 0;
+        threshold_ = 128;
+        add_trackbar("threshold", &threshold_, 255);
+        add_trackbar("(full,==,!=,<,>,<=,>=)", &op_, 6);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat res = compare_(image);
+        display(res);
+        return res;
+    }
+    virtual bool lut_(int type, Mat& table, bool& head)
+    {
+        if (CV_MAT_DEPTH(type) != CV_8U)
+            return false;
+        table = compare_(ramp_());
+        head = false;
+        return true;
+    }
+    // into a new Mat, the input is the kept output of the stage before.
+    Mat compare_(const Mat& image) const
+    {
+        static const int cmpops[] = { CMP_EQ, CMP_NE, CMP_LT, CMP_GT, CMP_LE, CMP_GE };
+        Mat res;
+        if (op_ >= 1 && op_ <= 6)
+            compare(image, threshold_, res, cmpops[op_ - 1]);
+        else
+            res = image.clone();
+        return res;
+    }
+    int op_;
+    int threshold_;
+};
+
+class range_filter : public itf_filter
+{
+public:
+    range_filter(const string& name) : itf_filter(name)
+    {
+        h1_ = s1_ = v1_ = 0;
+        h2_ = s2_ = v2_ = 255;
+		method_ = inv_ = mask_only_ = 0;
+        add_trackbar("h1(b,h)", &h1_, 255);
+        add_trackbar("h2(b,h)", &h2_, 255);
+        add_trackbar("s1(g,l)", &s1_, 255);
+        add_trackbar("s2(g,l)", &s2_, 255);
+        add_trackbar("v1(r,s)", &v1_, 255);
+        add_trackbar("v2(r,s)", &v2_, 255);
+        add_trackbar("hsv,bgr,hls", &method_, 2);
+        add_trackbar("invert mask", &inv_, 1);
+		add_trackbar("mask/no mask/mask only", &mask_only_, 2);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        // the converted image is the output, it has to be whole.
+        if (image.type() == CV_8UC3 && mask_only_ != 1)
+        {
+            Mat& res = output_();
+            fused_(image, res);
+            display(res);
+            return res;
+        }
+        Mat res;
+        Mat hsv, mask;
+        if (0 == method_)
+            cvtColor(image, hsv, CV_BGR2HSV);
+        else if (2 == method_)
+            cvtColor(image, hsv, CV_BGR2HLS);
+        else
+            hsv = image;
+        inRange(hsv,
+                Scalar(min(h1_, h2_), min(s1_, s2_), min(v1_, v2_)),
+                Scalar(max(h1_, h2_), max(s1_, s2_), max(v1_, v2_)),
+                mask);
+		if (mask_only_ == 2)
+			res = (inv_) ? ~mask : mask;
+		else if (mask_only_ == 0)
+			bitwise_and(image, image, res, (inv_) ? ~mask : mask);
+		else
+			res = hsv;
+        display(res);
+        return res;
+    }
+    // a block of rows at a time: cvtColor into a block that stays in
+    // cache, then one pass tests it and writes the mask or masked pixels.
+    void fused_(const Mat& image, Mat& res) const
+    {
+        bool mask_only = mask_only_ == 2;
+        res.create(image.size(), mask_only ? CV_8UC1 : image.type());
+        const uchar lo[3] = { (uchar)min(h1_, h2_), (uchar)min(s1_, s2_), (uchar)min(v1_, v2_) };
+        const uchar hi[3] = { (uchar)max(h1_, h2_), (uchar)max(s1_, s2_), (uchar)max(v1_, v2_) };
+        int code = 0 == method_ ? COLOR_BGR2HSV : 2 == method_ ? COLOR_BGR2HLS : -1;
+        bool inv = inv_ != 0;
+        void (*row)(const uchar*, const uchar*, uchar*, int, const uchar*, const uchar*, bool) =
+            mask_only ? &range_row_<true> : &range_row_<false>;
+        int block = max(1, (int)((32 << 10) / max((size_t)1, image.cols * image.elemSize())));
+        parallel_for_(Range(0, (image.rows + block - 1) / block), [&](const Range& range) {
+            Mat cvt;
+            for (int k = range.start; k < range.end; ++k)
+            {
+                int y0 = k * block, y1 = min(image.rows, y0 + block);
+                Mat src = image.rowRange(y0, y1);
+                if (code >= 0)
+                    cvtColor(src, cvt, code);
+                else
+                    cvt = src;
+                for (int y = 0; y < src.rows; ++y)
+                    row(src.ptr<uchar>(y), cvt.ptr<uchar>(y), res.ptr<uchar>(y0 + y), image.cols, lo, hi, inv);
+            }
+        });
+    }
+    // n pixels of t tested against [lo, hi], or outside it with inv: the
+    // 0/255 mask, or the pixel of src where it is set and 0 elsewhere.
+    template<bool mask_only>
+    static void range_row_(const uchar* src, const uchar* t, uchar* dst, int n,
+                           const uchar* lo, const uchar* hi, bool inv)
+    {
+        int x = 0;
+#if CV_SIMD && (CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9))
+        const int w = VTraits<v_uint8>::vlanes();
+        v_uint8 l0 = vx_setall_u8(lo[0]), l1 = vx_setall_u8(lo[1]), l2 = vx_setall_u8(lo[2]);
+        v_uint8 h0 = vx_setall_u8(hi[0]), h1 = vx_setall_u8(hi[1]), h2 = vx_setall_u8(hi[2]);
+        v_uint8 flip = vx_setall_u8(inv ? 255 : 0);
+        for (; x <= n - w; x += w)
+        {
+            v_uint8 a, b, c;
+            v_load_deinterleave(t + 3 * x, a, b, c);
+            v_uint8 m = v_and(v_and(v_ge(a, l0), v_le(a, h0)),
+                              v_and(v_and(v_ge(b, l1), v_le(b, h1)), v_and(v_ge(c, l2), v_le(c, h2))));
+            m = v_xor(m, flip);
+            if (mask_only)
+                v_store(dst + x, m);
+            else
+            {
+                v_load_deinterleave(src + 3 * x, a, b, c);
+                v_store_interleave(dst + 3 * x, v_and(a, m), v_and(b, m), v_and(c, m));
+            }
+        }
+        vx_cleanup();
+#endif
+        for (; x < n; ++x)
+        {
+            const uchar* p = t + 3 * x;
+            bool in = (lo[0] <= p[0] && p[0] <= hi[0] && lo[1] <= p[1] && p[1] <= hi[1] &&
+                       lo[2] <= p[2] && p[2] <= hi[2]) != inv;
+            if (mask_only)
+                dst[x] = in ? 255 : 0;
+            else
+            {
+                dst[3 * x] = in ? src[3 * x] : 0;
+                dst[3 * x + 1] = in ? src[3 * x + 1] : 0;
+                dst[3 * x + 2] = in ? src[3 * x + 2] : 0;
+            }
+        }
+    }
+    int h1_, h2_, s1_, s2_, v1_, v2_;
+    int method_;
+    int inv_;
+	int mask_only_;
+};
+
+class colormap_filter : public itf_filter
+{
+public:
+    colormap_filter(const string& name) : itf_filter(name)
+    {
+        type_ = 0;
+        table_type_ = -1;
+        add_trackbar("type:\n"
+                       "AUTUMN=0, BONE, JET, WINTER, RAINBOW,\n"
+                       "OCEAN=5, SUMMER, SPRING, COOL, HSV,\n"
+                       "PINK=10, HOT, PARULA, MAGMA, INFERNO,\n"
+                       "PLASMA=15, VIRIDIS, CIVIDIS, TWILIGHT,\n"
+                       "TWILIGHT_SHIFTED=19, TURBO, DEEPGREEN", &type_, 21);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        applyColorMap(image, res, type_);
+        display(res);
+        return res;
+    }
+    // applyColorMap makes BGR input gray first.
+    virtual bool lut_(int type, Mat& table, bool& head)
+    {
+        if (type != CV_8UC1 && type != CV_8UC3)
+            return false;
+        if (table_type_ != type_)
+        {
+            applyColorMap(ramp_(), table_, type_);
+            table_type_ = type_;
+        }
+        table = table_;
+        head = type == CV_8UC3;
+        return true;
+    }
+    virtual void lut_head_(const Mat& image, Mat& res)
+    {
+        cvtColor(image, res, COLOR_BGR2GRAY);
+    }
+    int type_;
+    Mat table_;
+    int table_type_;
+};
+
+/**
+feature
+    Feature2D is kind of Algorithm,
+        has two main functions, detect and compute.
+        1. detect corners KeyPoints
+        2. compute description Mat(rix).
+    A Feature2D backend may be detector or extractor or both.
+    SIFT, ORB, BRISK, KAZE, AKAZE, MSER.
+    FastFeatureDetector, AgastFeatureDetector, GFTTDetector, SimpleBlobDetector.
+    AffineFeature implementing the wrapper which makes detectors and extractors to be affine invariant.
+**/
+class feature_filter : public itf_filter
+{
+public:
+    feature_filter(const string& name) : itf_filter(name)
+    {
+        curfeat_ = -1;
+        feature_ = 0;
+        affine_ = 1;
+        curaff_ = affine_;
+        limits_ = 0;
+        add_trackbar("feat count", &limits_, INT_MAX);
+        add_trackbar("feature:\nsift:0\norb:1\nbrisk:2\n"
+                       "kaze:3\nakaze:4\nmser:5\n"
+                       "fast:6\nagast:7\ngftt:8\nblob:9\n", &feature_, 9);
+        add_trackbar("Affine (OFF/ON)", &affine_, 1);
+    }
+protected:
+    // feat count is fed back into its trackbar.
+    virtual bool proxy_ok_() const { return false; }
+    virtual Mat _filter(Mat& image)
+    {
+        Mat res = image;
+
+        bool changed = feature_ != curfeat_ || affine_ != curaff_ ;
+        curaff_ = affine_;
+        if (feature_ != curfeat_)
+        {
+            
+			switch (feature_)
+            {
+            // both detector and extractor
+#ifdef NON_FREE
+            case 0: backend_ = SIFT::create(); break;
+            case 1: backend_ = ORB::create(); break;
+            case 2: backend_ = BRISK::create(); break;
+            case 3: backend_ = KAZE::create(); break;
+            case 4: backend_ = AKAZE::create(); break;
+            // just detector
+            case 5: backend_ = MSER::create(); break;
+            case 6: backend_ = FastFeatureDetector::create(); break;
+            case 7: backend_ = AgastFeatureDetector::create(); break;
+            case 8: backend_ = GFTTDetector::create(); break;
+            case 9: backend_ = SimpleBlobDetector::create(); break;
+#endif
+			}
+#ifdef NON_FREE
+            ext_ = AffineFeature::create(backend_);
+#endif
+            curfeat_ = feature_;
+        }
+
+
+        vector<KeyPoint> kp1;
+        Mat desc1;
+        //ext_->detectAndCompute(image, Mat(), kp1, desc1);
+		if (affine_ && feature_ < 5)
+#ifdef NON_FREE
+			ext_->detect(image, kp1);
+#else
+			;
+#endif
+        else
+            backend_->detect(image, kp1);
+        trackbar_max("feat count", kp1.size());
+        trackbar_pos("feat count", kp1.size());
+        if (changed)
+            limits_ = kp1.size();
+        if (!visible())
+            return res;
+        Mat show = image.clone();
+        next_color(true);
+        for_each(kp1.begin(), kp1.begin() + limits_,
+                 [&](KeyPoint& kp) {
+                    circle(show, kp.pt, 3, next_color());
+                 });
+        display(show);
+        return res;
+    }
+    int feature_;
+    int curfeat_;
+    int affine_;
+    int curaff_;
+    int limits_;
+    Ptr<Feature2D> backend_;
+#ifdef NON_FREE
+    Ptr<AffineFeature> ext_;
+#endif
+};
+
+class blob_filter : public itf_filter
+{
+public:
+    blob_filter(const string& name) : itf_filter(name)
+    {
+#ifdef NON_FREE
+        SimpleBlobDetector::Params pDefaultBLOB;
+        pDefaultBLOB.thresholdStep = 10;
+        pDefaultBLOB.minThreshold = 10;
+        pDefaultBLOB.maxThreshold = 220;
+        pDefaultBLOB.minRepeatability = 2;
+        pDefaultBLOB.minDistBetweenBlobs = 10;
+        pDefaultBLOB.filterByColor = false;
+        pDefaultBLOB.blobColor = 0;
+        pDefaultBLOB.filterByArea = false;
+        pDefaultBLOB.minArea = 25;
+        pDefaultBLOB.maxArea = 5000;
+        pDefaultBLOB.filterByCircularity = false;
+        pDefaultBLOB.minCircularity = 0.9f;
+        pDefaultBLOB.maxCircularity = (float)1e37;
+        pDefaultBLOB.filterByInertia = false;
+        pDefaultBLOB.minInertiaRatio = 0.1f;
+        pDefaultBLOB.maxInertiaRatio = (float)1e37;
+        pDefaultBLOB.filterByConvexity = false;
+        pDefaultBLOB.minConvexity = 0.95f;
+        pDefaultBLOB.maxConvexity = (float)1e37;
+
+        // Param for first BLOB detector we want all
+        params_.push_back(pDefaultBLOB);
+        params_.back().filterByArea = true;
+        params_.back().minArea = 1;
+        params_.back().maxArea = 2900;
+        // Param for third BLOB detector we want only circular object
+        params_.push_back(pDefaultBLOB);
+        params_.back().filterByCircularity = true;
+        // Param for Fourth BLOB detector we want ratio inertia
+        params_.push_back(pDefaultBLOB);
+        params_.back().filterByInertia = true;
+        params_.back().minInertiaRatio = 0;
+        params_.back().maxInertiaRatio = (float)0.2;
+        // Param for fifth BLOB detector we want ratio inertia
+        params_.push_back(pDefaultBLOB);
+        params_.back().filterByConvexity = true;
+        params_.back().minConvexity = 0.;
+        params_.back().maxConvexity = (float)0.9;
+        // Param for six BLOB detector we want blob with gravity center color equal to 0
+        params_.push_back(pDefaultBLOB);
+        params_.back().filterByColor = true;
+        params_.back().blobColor = 0;
+#endif
+        curfeat_ = -1;
+        feature_ = 0;
+        affine_ = 1;
+        curaff_ = affine_;
+        limits_ = 0;
+        update_ = 1;
+        val1_ = val2_ = 500;
+        area1_ = 0;
+        area2_ = 2900;
+        color_ = 0;
+        bgorigin_ = 0;
+        add_trackbar("feat count", &limits_, INT_MAX);
+        add_trackbar("feature:\nArea:0\nCircularity:1\nInertia:2\n"
+                       "Convexity:3\nColor:4\n", &feature_, 4);
+        add_trackbar("area (bound 1)", &area1_, 10000);
+        add_trackbar("area (bound 2)", &area2_, 10000);
+        add_trackbar("val (bound 1)", &val1_, 1000);
+        add_trackbar("val (bound 2)", &val2_, 1000);
+        add_trackbar("color", &color_, 255);
+        add_trackbar("use origin (OFF/ON)", &bgorigin_, 1);
+    }
+protected:
+    // feat count is fed back into its trackbar.
+    virtual bool proxy_ok_() const { return false; }
+    Ptr<Feature2D> getBackend()
+    {
+        if (!backends_[feature_])
+        {
+#ifdef NON_FREE
+            backends_[feature_] = SimpleBlobDetector::create(params_[feature_]);
+#endif
+		}
+        else if (update_)
+        {
+            switch (feature_)
+            {
+            case 0:
+                {
+                    SimpleBlobDetector::Params& param = params_[feature_];
+                    param.minArea = min(area1_, area2_);
+                    param.maxArea = max(area1_, area2_);
+                }
+                break;
+            case 1:
+                {
+                    // bug if val1 >= .9, val2 should not be [.9, 1.)
+                    SimpleBlobDetector::Params& param = params_[feature_];
+                    param.minCircularity = .001*min(val1_, val2_);
+                    param.maxCircularity = .001*max(val1_, val2_);
+                }
+                break;
+            case 2:
+                {
+                    SimpleBlobDetector::Params& param = params_[feature_];
+                    param.minInertiaRatio = .001*min(val1_, val2_);
+                    param.maxInertiaRatio = .001*max(val1_, val2_);
+                }
+                break;
+            case 3:
+                {
+                    SimpleBlobDetector::Params& param = params_[feature_];
+                    param.minConvexity = .001*min(val1_, val2_);
+                    param.maxConvexity = .001*max(val1_, val2_);
+                }
+                break;
+            case 4:
+                {
+                    SimpleBlobDetector::Params& param = params_[feature_];
+                    param.blobColor = color_;
+                }
+                break;
+            }
+#ifdef NON_FREE
+            backends_[feature_] = SimpleBlobDetector::create(params_[feature_]);
+#endif
+		}
+        return backends_[feature_];
+    }
+    virtual Mat _filter(Mat& image)
+    {
+        Mat res = image;
+
+        bool changed = feature_ != curfeat_ || affine_ != curaff_ ;
+        curaff_ = affine_;
+        if (changed)
+        {
+           switch (feature_)
+           {
+           case 0:
+               {
+               }
+               break;
+           case 1:
+               {
+                    trackbar_pos("val (bound 1)", params_[feature_].minCircularity*1000);
+                    trackbar_pos("val (bound 2)", params_[feature_].maxCircularity*1000);
+               }
+               break;
+           case 2:
+               {
+                    trackbar_pos("val (bound 1)", params_[feature_].minInertiaRatio*1000);
+                    trackbar_pos("val (bound 2)", params_[feature_].maxInertiaRatio*1000);
+               }
+               break;
+           case 3:
+               {
+                    trackbar_pos("val (bound 1)", params_[feature_].minConvexity*1000);
+                    trackbar_pos("val (bound 2)", params_[feature_].maxConvexity*1000);
+               }
+               break;
+           case 4:
+               {
+               }
+               break;
+           }
+        }
+        Ptr<Feature2D> backend = getBackend();
+
+
+        vector<KeyPoint> kp1;
+        Mat desc1;
+        backend->detect(image, kp1);
+        trackbar_max("feat count", kp1.size());
+        trackbar_pos("feat count", kp1.size());
+        if (changed)
+            limits_ = kp1.size();
+        if (!visible())
+            return res;
+        Mat src = (bgorigin_)? graph_->origin() : image;
+        Mat show = src.clone();
+#ifdef NON_FREE
+        drawKeypoints(src, kp1, show);
+#endif
+        next_color(true);
+        if (limits_)
+            for_each(kp1.begin(), kp1.begin() + limits_,
+                     [&](KeyPoint& kp) {
+                        circle(show, kp.pt, kp.size, next_color());
+                     });
+        display(show);
+        return res;
+    }
+    int feature_;
+    int curfeat_;
+    int affine_;
+    int curaff_;
+    int limits_;
+    int update_;
+    int area1_, area2_;
+    int val1_, val2_;
+    int color_;
+    int bgorigin_;
+    map<int, Ptr<Feature2D> > backends_;
+    vector<SimpleBlobDetector::Params> params_;
+};
+
+// opencv/samples/cpp/digits.cpp
+class deskew_filter : public itf_filter
+{
+public:
+    deskew_filter(const string& name) : itf_filter(name)
+    {
+        sz_ = 20;
+        add_trackbar("size", &sz_, 10000);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        if (!image.empty())
+            trackbar_max("size", cvRound(max(image.cols, image.rows) / scale()));
+        sz_ = max(1, sz_);
+        int sz = max(1, scaled(sz_));
+        Moments m = moments(image);
+        if (abs(m.mu02) < 0.01)
+        {
+            image.copyTo(res);
+        }
+        else
+        {
+            float skew = (float)(m.mu11 / m.mu02);
+            float M_vals[2][3] = {{1, skew, -0.5f * sz * skew}, {0, 1, 0}};
+            Mat M(Size(3, 2), CV_32F);
+
+            for (int i = 0; i < M.rows; i++)
+            {
+                for (int j = 0; j < M.cols; j++)
+                {
+                    M.at<float>(i, j) = M_vals[i][j];
+                }
+            }
+
+            warpAffine(image, res, M, Size(sz, sz), WARP_INVERSE_MAP | INTER_LINEAR);
+        }
+        display(res);
+        return res;
+    }
+    int sz_;
+};
+
+// op
+class cut_filter : public itf_filter
+{
+public:
+    cut_filter(const string& name) : itf_filter(name)
+    {
+        use_save_ = true;
+        state_ = cut_IDLE;
+        if (!headless())
+            setMouseCallback(name_, on_mouse, this);
+    }
+	cut_filter(const string& name, const string& comment) : itf_filter(name, comment)
+	{
+		use_save_ = true;
+		state_ = cut_IDLE;
+		if (!headless())
+			setMouseCallback(name_, on_mouse, this);
+	}
+    cut_filter& apply(function<void(Mat,Mat)> f)
+    {
+        apply_ = f;
+        return *this;
+    }
+protected:
+    // regions are in full size mouse coordinates.
+    virtual bool proxy_ok_() const { return false; }
+    static void on_mouse(int event, int x, int y, int flags, void* ctx)
+    {
+        ((cut_filter*)ctx)->_on_mouse(event, x, y, flags, ctx);
+    }
+    virtual void _on_mouse(int event, int x, int y, int flags, void* ctx)
+    {
+        ostringstream os;
+        // written by _filter on the worker thread.
+        Mat curve;
+        {
+            unique_lock<mutex> lock = lock_();
+            curve = curve_;
+        }
+        switch (event)
+        {
+#ifdef HAVE_QT
+		case EVENT_MBUTTONDBLCLK:
+#else
+		case EVENT_RBUTTONDBLCLK:
+#endif
+            if (cut_FIN == state_)
+            {
+                Mat dst;
+                curve(rect_).copyTo(dst);
+                os << "cut_"
+                         << rect_.x << "_"
+                         << rect_.y << "_"
+                         << rect_.width << "_"
+                         << rect_.height;
+                if (EVENT_FLAG_CTRLKEY & flags)
+                    os << ".bmp";
+                else if (EVENT_FLAG_SHIFTKEY & flags)
+                    os << ".jpg";
+                else
+                    os << ".png";
+                if (use_save_)
+                    sample_writer::instance().write(os.str(), dst);
+                {
+                    unique_lock<mutex> lock = lock_();
+                    cutrect_ = rect_;
+                    cut_ = dst;
+                }
+                if (apply_)
+                    apply_(curve, dst);
+            }
+            state_ = cut_SAVE;
+            break;
+        case EVENT_LBUTTONDOWN:
+            state_ = cut_EDIT;
+            rect_.x = max(0, x);
+            rect_.y = max(0, y);
+            break;
+        case EVENT_MOUSEMOVE:
+            if (cut_EDIT == state_)
+            {
+                rect_.width = max(0, x) - rect_.x;
+                rect_.height = max(0, y) - rect_.y;
+            }
+            break;
+        case EVENT_LBUTTONUP:
+            if (cut_EDIT == state_)
+            {
+                if (0 == rect_.width)
+                    rect_.width = 4;
+                if (0 == rect_.height)
+                    rect_.height = 4;
+                if (rect_.width < 0)
+                {
+                    rect_.x += rect_.width;
+                    rect_.width -= rect_.width + rect_.width;
+                }
+                if (rect_.height < 0)
+                {
+                    rect_.y += rect_.height;
+                    rect_.height -= rect_.height + rect_.height;
+                }
+                if (rect_.y + rect_.height > curve.rows)
+                {
+                    rect_.height = curve.rows - rect_.y;
+                }
+                if (rect_.x + rect_.width > curve.cols)
+                {
+                    rect_.width = curve.cols - rect_.x;
+                }
+                state_ = cut_FIN;
+            }
+            break;
+        }
+
+        if (state_ > cut_IDLE)
+        {
+            Mat show;
+            curve.copyTo(show);
+            if (state_ < cut_RESET)
+                rectangle(show, Point( rect_.x, rect_.y ), Point(rect_.x + rect_.width, rect_.y + rect_.height ), Scalar(0, 255, 0), 1);
+            else
+            {
+                if (cut_SAVE == state_)
+                {
+                    rectangle(show, Point( cutrect_.x, cutrect_.y ), Point(cutrect_.x + cutrect_.width, cutrect_.y + cutrect_.height ), Scalar(0, 0, 255), 1);
+                    putText(show, (os << " saved!", os).str(), Point(0, 20), cv::FONT_HERSHEY_DUPLEX, 1.0, CV_RGB(118, 185, 0));
+                }
+                state_ = cut_IDLE;
+            }
+            display(show);
+        }
+    }
+    virtual Mat _filter(Mat& image)
+    {
+        Rect cutrect;
+        Mat cut;
+        {
+            unique_lock<mutex> lock = lock_();
+            curve_ = image;
+            state_ = cut_IDLE;
+            cutrect = cutrect_;
+            cut = cut_;
+        }
+        //rect_ = Rect();
+        if (cutrect.empty())
+            display(image);
+        else
+        {
+            Mat show;
+            image.copyTo(show);
+            rectangle(show, Point(cutrect.x, cutrect.y ), Point(cutrect.x + cutrect.width, cutrect.y + cutrect.height ), Scalar(0, 0, 255), 1);
+            display(show);
+        }
+        if (apply_)
+            apply_(image, cut);
+        return image;
+    }
+    Rect fullrect_;
+    Rect rect_;
+    Rect cutrect_;
+    enum {
+        cut_IDLE,
+        cut_EDIT,
+        cut_FIN,
+        cut_RESET,
+        cut_SAVE,
+    } state_;
+    Mat curve_;
+    Mat cut_;
+    bool use_save_;
+    function<void(Mat,Mat)> apply_;
+};
+
+// cut2
+// generate pos/$time.jpg and neg/$time.jpg
+// append info to pos/pos.txt and neg/neg.txt
+class cut2_filter : public itf_filter
+{
+public:
+    cut2_filter(const string& name) : itf_filter(name)
+    {
+        use_save_ = true;
+        state_ = cut_IDLE;
+        if (!headless())
+            setMouseCallback(name_, on_mouse, this);
+    }
+protected:
+    // regions are in full size mouse coordinates.
+    virtual bool proxy_ok_() const { return false; }
+    static void on_mouse(int event, int x, int y, int flags, void* ctx)
+    {
+        ((cut2_filter*)ctx)->_on_mouse(event, x, y, flags, ctx);
+    }
+public:
+    // positives go straight into this .vec, at the training window size,
+    // instead of pos/*.png and pos/pos.txt. empty for the png files.
+    static string& vec_path()
+    {
+        static string path;
+        return path;
+    }
+    static Size& vec_size()
+    {
+        static Size size(24, 24);
+        return size;
+    }
+protected:
+    void save_vec(const Mat& curve)
+    {
+        static shared_ptr<vec_file> vec;
+        if (!vec)
+            vec = make_shared<vec_file>(vec_path(), vec_size());
+        sample_writer::job j;
+        j.image = curve;
+        j.vec = vec;
+        j.crops = posrect_;
+        sample_writer::instance().write(j);
+    }
+    void save_pos(const string& name, const Mat& curve)
+    {
+#ifdef HAVE_WIN32UI
+		_wmkdir(L"pos/");
+#endif
+        ostringstream fout;
+        fout << "pos/" << name << " ";
+        fout << posrect_.size() << " ";
+        for_each(posrect_.begin(), posrect_.end(),
+                 [&](Rect& rect){
+                     fout << rect.x << " "
+                        << rect.y << " "
+                        << rect.width << " "
+                        << rect.height << " ";
+                 });
+        fout << "\n";
+        sample_writer::job j;
+        j.path = "pos/" + name;
+        j.image = curve;
+        j.info = "pos/pos.txt";
+        j.line = fout.str();
+        sample_writer::instance().write(j);
+    }
+    // the frame with every positive region blacked out, on the writer thread.
+    void save_neg(const string& name, const Mat& curve)
+    {
+#ifdef HAVE_WIN32UI
+		_wmkdir(L"neg/");
+#endif
+        sample_writer::job j;
+        j.path = "neg/" + name;
+        j.image = curve;
+        j.blank = posrect_;
+        j.info = "neg/neg.txt";
+        j.line = "neg/" + name + "\n";
+        sample_writer::instance().write(j);
+    }
+    void _on_mouse(int event, int x, int y, int flags, void* ctx)
+    {
+        ostringstream os;
+        // written by _filter on the worker thread.
+        Mat curve;
+        {
+            unique_lock<mutex> lock = lock_();
+            curve = curve_;
+        }
+        switch (event)
+        {
+        case EVENT_MBUTTONDOWN:
+#ifdef HAVE_QT
+			if (!(EVENT_FLAG_CTRLKEY & flags))
+				break;
+#endif
+            state_ = cut_IDLE;
+            rect_ = Rect();
+            posrect_.clear();
+            break;
+#ifdef HAVE_QT
+		case EVENT_MBUTTONDBLCLK:
+#else
+		case EVENT_RBUTTONDBLCLK:
+#endif
+            if (!posrect_.empty())
+            {
+                cutrect_ = rect_;
+                time_t ts = time(0);
+                os << "cascade_"
+                         << ts;
+                if (EVENT_FLAG_CTRLKEY & flags)
+                    os << ".bmp";
+                else if (EVENT_FLAG_SHIFTKEY & flags)
+                    os << ".jpg";
+                else
+                    os << ".png";
+                if (vec_path().empty())
+                    save_pos(os.str(), curve);
+                else
+                    save_vec(curve);
+                save_neg(os.str(), curve);
+
+                posrect_.clear();
+                //rect_ = Rect();
+                saved_name_ = os.str();
+            }
+            state_ = cut_SAVE;
+            break;
+        case EVENT_LBUTTONDOWN:
+            state_ = cut_PREEDIT;
+            rect_.x = max(0, x);
+            rect_.y = max(0, y);
+            if (EVENT_FLAG_CTRLKEY & flags)
+            {
+                state_ = cut_EDIT;
+                rect_.width = 0;
+                rect_.height = 0;
+            }
+            break;
+        case EVENT_MOUSEMOVE:
+            if (cut_EDIT == state_
+                && (EVENT_FLAG_CTRLKEY & flags))
+            {
+                rect_.width = max(0, x) - rect_.x;
+                rect_.height = max(0, y) - rect_.y;
+            }
+            break;
+        case EVENT_LBUTTONDBLCLK:
+            if (!(EVENT_FLAG_CTRLKEY & flags)
+                && rect_.width && rect_.height)
+            {
+                rect_.x = max(0, x);
+                rect_.y = max(0, y);
+                if (rect_.y + rect_.height > curve.rows)
+                {
+                    rect_.height = curve.rows - rect_.y;
+                }
+                if (rect_.x + rect_.width > curve.cols)
+                {
+                    rect_.width = curve.cols - rect_.x;
+                }
+                posrect_.push_back(rect_);
+                state_ = cut_FIN;
+            }
+            break;
+        case EVENT_LBUTTONUP:
+            if (cut_EDIT == state_
+                && (EVENT_FLAG_CTRLKEY & flags))
+            {
+                if (0 == rect_.width)
+                    rect_.width = 4;
+                if (0 == rect_.height)
+                    rect_.height = 4;
+                if (rect_.width < 0)
+                {
+                    rect_.x += rect_.width;
+                    rect_.width -= rect_.width + rect_.width;
+                }
+                if (rect_.height < 0)
+                {
+                    rect_.y += rect_.height;
+                    rect_.height -= rect_.height + rect_.height;
+                }
+                if (rect_.y + rect_.height > curve.rows)
+                {
+                    rect_.height = curve.rows - rect_.y;
+                }
+                if (rect_.x + rect_.width > curve.cols)
+                {
+                    rect_.width = curve.cols - rect_.x;
+                }
+                posrect_.push_back(rect_);
+                state_ = cut_FIN;
+            }
+            break;
+        }
+
+        /**
+        if (state_ > cut_IDLE)
+        {
+            Mat show;
+            curve_.copyTo(show);
+            if (state_ < cut_RESET)
+                rectangle(show, Point( rect_.x, rect_.y ), Point(rect_.x + rect_.width, rect_.y + rect_.height ), Scalar(0, 255, 0), 1);
+            else
+            {
+                if (cut_SAVE == state_)
+                {
+                    putText(show, (os << " saved!", os).str(), Point(0, 20), cv::FONT_HERSHEY_DUPLEX, 1.0, CV_RGB(118, 185, 0));
+                }
+                state_ = cut_IDLE;
+            }
+            for_each(posrect_.begin(), posrect_.end(),
+                     [&](Rect& rect){
+                        rectangle(show, Point( rect.x, rect.y ), Point(rect.x + rect.width, rect.y + rect.height ), Scalar(0, 0, 255), 1);
+                     });
+            display(show);
+        }
+        */
+        show(curve);
+        if (cut_SAVE == state_)
+            state_ = cut_IDLE;
+    }
+    void show(const Mat& curve)
+    {
+        if (posrect_.empty() && state_ == cut_IDLE)
+        {
+            display(curve);
+            return;
+        }
+        Mat show;
+        curve.copyTo(show);
+        if (state_ > cut_IDLE && state_ < cut_RESET)
+        {
+            rectangle(show, Point( rect_.x, rect_.y ), Point(rect_.x + rect_.width, rect_.y + rect_.height ), Scalar(0, 255, 0), 1);
+        }
+        if (cut_SAVE == state_)
+        {
+            putText(show, saved_name_, Point(0, 20), cv::FONT_HERSHEY_DUPLEX, 1.0, CV_RGB(118, 185, 0));
+        }
+        for_each(posrect_.begin(), posrect_.end(),
+                     [&](Rect& rect){
+                        rectangle(show, Point( rect.x, rect.y ), Point(rect.x + rect.width, rect.y + rect.height ), Scalar(0, 0, 255), 1);
+                     });
+        display(show);
+    }
+    virtual Mat _filter(Mat& image)
+    {
+        {
+            unique_lock<mutex> lock = lock_();
+            curve_ = image;
+            state_ = cut_IDLE;
+        }
+        //rect_ = Rect();
+        /**
+        if (cutrect_.empty())
+            display(curve_);
+        else
+        {
+            Mat show;
+            curve_.copyTo(show);
+            rectangle(show, Point(cutrect_.x, cutrect_.y ), Point(cutrect_.x + cutrect_.width, cutrect_.y + cutrect_.height ), Scalar(0, 0, 255), 1);
+            display(show);
+        }
+        */
+        show(image);
+        return image;
+    }
+    Rect fullrect_;
+    Rect rect_;
+    Rect cutrect_;
+    vector<Rect> posrect_;
+    enum {
+        cut_IDLE,
+        cut_PREEDIT,
+        cut_EDIT,
+        cut_FIN,
+        cut_RESET,
+        cut_SAVE,
+    } state_;
+    Mat curve_;
+    string saved_name_;
+    bool use_save_;
+};
+
+typedef cut2_filter anno_filter;
+
+class crop_filter : public cut_filter
+{
+public:
+    crop_filter(const string& name) : cut_filter(name)
     {
-        ostringstream os;
-        switch (event)
+        use_save_  = false;
+        apply([this](Mat, Mat crop){
+              if (state_ == cut_FIN)
+                  update_next_(crop, crop);
+        });
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat res = image;
+        cut_filter::_filter(image);
+
+        Rect cutrect;
+        bool cut;
         {
-        case EVENT_MBUTTONDOWN:
-#ifdef HAVE_QT
-			if (!(EVENT_FLAG_CTRLKEY & flags))
-				break;
-#endif
-            state_ = cut_IDLE;
-            rect_ = Rect();
-            posrect_.clear();
-            break;
-#ifdef HAVE_QT
-		case EVENT_MBUTTONDBLCLK:
+            unique_lock<mutex> lock = lock_();
+            cutrect = cutrect_;
+            cut = !cut_.empty();
+        }
+        if (!cutrect.empty() && cut)
+        {
+            // a new one, the mouse callback may still hold the last.
+            Mat crop;
+            image(cutrect & Rect(0, 0, image.cols, image.rows)).copyTo(crop);
+            res = crop;
+            graph_->update_origin(crop);
+        }
+        return res;
+    }
+    Mat crop_;
+};
+
+class zoom_filter : public itf_filter
+{
+public:
+    zoom_filter(const string& name) : itf_filter(name)
+    {
+        x_ = 100;
+        y_ = 100;
+        inter_ = 1;
+        add_trackbar("zoom x(%)", &x_, 400);
+        add_trackbar("zoom y(%)", &y_, 400);
+        add_trackbar("interpola:\n"
+            "INTER_NEAREST        = 0,\n"
+            "INTER_LINEAR         = 1,\n"
+            "INTER_CUBIC          = 2,\n"
+            "INTER_AREA           = 3,\n"
+            "INTER_LANCZOS4       = 4,\n"
+            "INTER_LINEAR_EXACT = 5, \n"
+            "INTER_NEAREST_EXACT  = 6,\n"
+            "INTER_MAX            = 7,\n", &inter_, 7);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat& res = output_();
+        trackbar_min("zoom x(%)", 50);
+        trackbar_min("zoom y(%)", 50);
+        if (x_ != 100 || y_ != 100)
+            resize(image, res, Size(), x_/100., y_/100., inter_);
+        else
+            res = image;
+        graph_->update_origin(res);
+        display(res);
+        return res;
+    }
+    int x_;
+    int y_;
+    int inter_;
+};
+
+// apply
+class contours_filter : public itf_filter
+{
+public:
+	contours_filter(const string& name) : itf_filter(name)
+	{
+		threshold_ = 20;
+		retr_ = 1;
+		showpoly_ = 1;
+		showcontours_ = 1;
+		showconvexHull_ = 0;
+		showarea_ = 0;
+		last_max_area_ = 0;
+		add_trackbar("threshold*.001", &threshold_, 200);
+		add_trackbar("show poly(OFF/ON)", &showpoly_, 1);
+		add_trackbar("show contours(OFF/ON)", &showcontours_, 1);
+		add_trackbar("show area(OFF/MAX)", &showarea_, 1);
+		add_trackbar("show convexHull(OFF/ON)", &showconvexHull_, 1);
+		add_trackbar("RETR:\n"
+			"0 - RETR_EXTERNAL \n"
+			"1 - RETR_LIST\n"
+			"2 - RETR_CCOMP\n"
+			"3 - RETR_TREE\n"
+			"4 - RETR_FLOODFILL\n", &retr_, 4);
+	}
+protected:
+	virtual Mat _filter(Mat& image)
+	{
+		vector<vector<Point> > contours;
+#if CV_VERSION_MAJOR < 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR < 2)
+		// findContours wrote into its input before 3.2.
+		findContours(image.clone(), contours, retr_, CHAIN_APPROX_SIMPLE);
 #else
-		case EVENT_RBUTTONDBLCLK:
+		findContours(image, contours, retr_, CHAIN_APPROX_SIMPLE);
 #endif
-            if (!posrect_.empty())
-            {
-                Mat dst;
-                cutrect_ = rect_;
-                curve_(cutrect_).copyTo(dst);
-                time_t ts = time(0);
-                os << "cascade_"
-                         << ts;
-                if (EVENT_FLAG_CTRLKEY & flags)
-                    os << ".bmp";
-                else if (EVENT_FLAG_SHIFTKEY & flags)
-                    os << ".jpg";
-                else
-                    os << ".png";
-                save_pos(os.str());
-                save_neg(os.str());
+		vector<Point> approx;
 
-                posrect_.clear();
-                //rect_ = Rect();
-                saved_name_ = os.str();
-            }
-            state_ = cut_SAVE;
-            break;
-        case EVENT_LBUTTONDOWN:
-            state_ = cut_PREEDIT;
-            rect_.x = max(0, x);
-            rect_.y = max(0, y);
-            if (EVENT_FLAG_CTRLKEY & flags)
-            {
-                state_ = cut_EDIT;
-                rect_.width = 0;
-                rect_.height = 0;
-            }
-            break;
-        case EVENT_MOUSEMOVE:
-            if (cut_EDIT == state_
-                && (EVENT_FLAG_CTRLKEY & flags))
-            {
-                rect_.width = max(0, x) - rect_.x;
-                rect_.height = max(0, y) - rect_.y;
-            }
-            break;
-        case EVENT_LBUTTONDBLCLK:
-            if (!(EVENT_FLAG_CTRLKEY & flags)
-                && rect_.width && rect_.height)
+		Mat origin = graph_->origin();
+		/// Z#20250303
+		int area = 0;
+		if (!origin.empty())
+		{
+			area = cvRound(origin.rows * origin.cols / (scale() * scale()));
+			if (area != last_max_area_)
+			{
+				last_max_area_ = area;
+				if (showarea_ > 0)
+					showarea_ = min(last_max_area_, showarea_);
+				trackbar_max("show area(OFF/MAX)", last_max_area_);
+			}
+		}
+		else
+		{
+			showarea_ = 0;
+			last_max_area_ = 0;
+			trackbar_max("show area(OFF/MAX)", 1);
+		}
+		if (!visible())
+			return image;
+		Mat show = origin.clone();
+
+		// test each contour
+		if (showpoly_)
+			for (size_t i = 0; i < contours.size(); i++)
+			{
+				approxPolyDP(contours[i], approx, arcLength(contours[i], true)*threshold_ / 1000., true);
+				polylines(show, approx, true, Scalar(255, 0, 0), 2, LINE_AA);
+			}
+		if (showcontours_)
+			drawContours(show, contours, -1, Scalar(0, 255, 0), 1, LINE_AA);
+		if (showconvexHull_)
+		{
+			for (size_t i = 0; i < contours.size(); i++)
+			{
+				std::vector<cv::Point> hull;
+				auto& points = contours[i];
+				cv::convexHull(points, hull);
+				for (size_t i = 0; i < hull.size() && hull.size() > 5; i++)
+				{
+					cv::line(show, hull[i], hull[(i + 1) % hull.size()], cv::Scalar(0, 0, 255), 3, LINE_AA);
+				}
+			}
+		}
+		if (showarea_)
+		{
+			for (size_t i = 0; i< contours.size(); i++) 
+			{
+				using namespace cv;
+				auto& src = show;
+				double area = contourArea(contours[i]);
+				double length = arcLength(contours[i], true);
+
+				if (area < showarea_ * scale() * scale()) {
+					continue;
+				}
+				cout << "area = " << area << ", length = " << length << endl;
+				RotatedRect rrt = minAreaRect(contours[i]);// ȡСӾ
+
+				Point2f pt[4];
+				rrt.points(pt);
+				line(src, pt[0], pt[1], Scalar(128, 128, 0), 8, 8);
+				line(src, pt[1], pt[2], Scalar(128, 128, 0), 8, 8);
+				line(src, pt[2], pt[3], Scalar(128, 128, 0), 8, 8);
+				line(src, pt[3], pt[0], Scalar(128, 128, 0), 8, 8);
+				Point  center = rrt.center;
+				circle(src, center, 2, Scalar(0, 0, 128), 8, 8); // СӾεĵ
+			}
+		}
+		display(show);
+		return image;
+	}
+	int threshold_;
+	int retr_;
+	int showpoly_;
+	int showcontours_;
+	int showconvexHull_;
+	int showarea_;
+	int last_max_area_;
+};
+
+typedef contours_filter convexHull_filter;
+
+class match_filter : public cut_filter
+{
+public:
+    match_filter(const string& name) : cut_filter(name, " (select) ")
+    {
+        use_save_ = false;
+        use_mask_ = false;
+        image_window_ = "Match Image " + name_;
+        result_window_ = "Result window " + name_;
+        if (!headless())
+        {
+            namedWindow(image_window_, WINDOW_AUTOSIZE );
+            namedWindow(result_window_, WINDOW_AUTOSIZE );
+        }
+        add_trackbar("Method: \n 0: SQDIFF \n 1: SQDIFF NORMED \n 2: TM CCORR \n 3: TM CCORR NORMED \n 4: TM COEFF \n 5: TM COEFF NORMED",
+                        image_window_, &match_method_, max_Trackbar_, MatchingMethod, this);
+        add_trackbar("threshold*.001%", image_window_, &threshold, 10000, MatchingMethod, this);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        if (!apply_)
+            apply([&](Mat res, Mat sel){
+                  img_ = res;
+                  if (!sel.empty())
+                      templ_ = sel;
+                  _MatchingMethod();
+				  if (is_on_mouse_ && !headless())
+				  {
+					  setWindowProperty(result_window_, 5, 0);
+					  setWindowProperty(image_window_, 5, 0);
+				  }
+            });
+        return cut_filter::_filter(image);
+    }
+	virtual void _on_mouse(int event, int x, int y, int flags, void* ctx)
+	{
+		is_on_mouse_ = true;
+		cut_filter::_on_mouse(event, x, y, flags, ctx);
+		is_on_mouse_ = false;
+	}
+    static void MatchingMethod(int, void* ctx)
+    {
+        ((match_filter*)ctx)->_MatchingMethod();
+    }
+    void _MatchingMethod()
+    {
+        Mat img_display;
+        if (templ_.empty())
+            return;
+        img_.copyTo(img_display);
+        if (img_.type() != templ_.type()
+            && (img_.type() == CV_8UC1 && templ_.type() == CV_8UC3))
+        {
+            Mat tmp;
+            cvtColor(templ_, tmp, CV_BGR2GRAY);
+            templ_ = tmp;
+        }
+        int result_cols =  img_.cols - templ_.cols + 1;
+        int result_rows = img_.rows - templ_.rows + 1;
+        result_.create( result_rows, result_cols, CV_32FC1 );
+        bool method_accepts_mask = (CV_TM_SQDIFF == match_method_ || match_method_ == CV_TM_CCORR_NORMED);
+        if (use_mask_ && method_accepts_mask)
+        {
+            matchTemplate(img_, templ_, result_, match_method_, mask_);
+        }
+        else
+        {
+            matchTemplate(img_, templ_, result_, match_method_);
+        }
+        if (!(match_method_ & 1))
+            normalize(result_, result_, 0, 1, NORM_MINMAX, -1, Mat());
+        double minVal; double maxVal; Point minLoc; Point maxLoc;
+        Point matchLoc;
+        double matchVal;
+        minMaxLoc(result_, &minVal, &maxVal, &minLoc, &maxLoc, Mat());
+        if (match_method_  == TM_SQDIFF || match_method_ == TM_SQDIFF_NORMED)
+        {
+            matchLoc = minLoc;
+            matchVal = minVal;
+        }
+        else
+        {
+            matchLoc = maxLoc;
+            matchVal = maxVal;
+        }
+        if (0 == threshold)
+        {
+            rectangle(img_display, matchLoc, Point(matchLoc.x + templ_.cols , matchLoc.y + templ_.rows ), Scalar::all(0), 1, LINE_AA, 0 );
+            rectangle(result_, matchLoc, Point(matchLoc.x + templ_.cols , matchLoc.y + templ_.rows ), Scalar::all(0), 1, LINE_AA, 0 );
+        }
+        else
+        {
+            static const Scalar colors[] =
             {
-                rect_.x = max(0, x);
-                rect_.y = max(0, y);
-                if (rect_.y + rect_.height > curve_.rows)
-                {
-                    rect_.height = curve_.rows - rect_.y;
-                }
-                if (rect_.x + rect_.width > curve_.cols)
-                {
-                    rect_.width = curve_.cols - rect_.x;
-                }
-                posrect_.push_back(rect_);
-                state_ = cut_FIN;
-            }
-            break;
-        case EVENT_LBUTTONUP:
-            if (cut_EDIT == state_
-                && (EVENT_FLAG_CTRLKEY & flags))
+                Scalar(0,0,0),
+                Scalar(255,0,0),
+                Scalar(255,128,0),
+                Scalar(255,255,0),
+                Scalar(0,255,0),
+                Scalar(0,128,255),
+                Scalar(0,255,255),
+                Scalar(0,0,255),
+                Scalar(255,0,255)
+            };
+            float* it = (float*)result_.data;
+            const int cxr = result_.cols * result_.rows;
+            double threshold1000 = threshold / 100000.;
+            for (int i = 0; i < cxr; ++i, ++it)
             {
-                if (0 == rect_.width)
-                    rect_.width = 4;
-                if (0 == rect_.height)
-                    rect_.height = 4;
-                if (rect_.width < 0)
-                {
-                    rect_.x += rect_.width;
-                    rect_.width -= rect_.width + rect_.width;
-                }
-                if (rect_.height < 0)
-                {
-                    rect_.y += rect_.height;
-                    rect_.height -= rect_.height + rect_.height;
-                }
-                if (rect_.y + rect_.height > curve_.rows)
-                {
-                    rect_.height = curve_.rows - rect_.y;
-                }
-                if (rect_.x + rect_.width > curve_.cols)
+                if (fabs(*it - matchVal) <= threshold1000)
                 {
-                    rect_.width = curve_.cols - rect_.x;
+                    Point pt(i % result_.cols, i / result_.cols);
+                    rectangle( img_display, pt, Point(pt.x + templ_.cols , pt.y + templ_.rows), colors[i%8], 1, LINE_AA, 0 );
+                    //rectangle( result, matchLoc, Point( pt.x + templ.cols , pt.y + templ.rows ), Scalar::all(0), 1, LINE_AA, 0 );
                 }
-                posrect_.push_back(rect_);
-                state_ = cut_FIN;
             }
-            break;
         }
+        if (!headless())
+        {
+            imshow(image_window_, img_display);
+            imshow(result_window_, result_);
+        }
+        return;
+    }
+    bool use_mask_ = false;
+    Mat img_, templ_, mask_, result_;
+    string image_window_;
+    string result_window_;
+    int match_method_ = 0;
+    int max_Trackbar_ = 5;
+    int threshold = 0;
+    bool init = false;
+	bool is_on_mouse_ = false;
+};
 
-        /**
-        if (state_ > cut_IDLE)
+class cascade_filter : public itf_filter
+{
+public:
+    cascade_filter(const string& name) : itf_filter(name)
+    {
+        algo1_ = algo2_ = algo3_ = algo4_ = 0;
+        algo2_ = 1;
+        x_ = 15;
+        y_ = 15;
+        scalefactor_ = 15;
+        minneighbros_ = 3;
+        cascade_.load(samples::findFile("cascade/cascade.xml"));
+        //add_trackbar("scalefactor*.01 + 1", &scalefactor_, 100);
+        //add_trackbar("min neighbros", &minneighbros_, 10);
+        //add_trackbar("DO_CANNY_PRUNING   (OFF/ON)", &algo1_, 1);
+        //add_trackbar("SCALE_IMAGE        (OFF/ON)", &algo2_, 1);
+        //add_trackbar("FIND_BIGGEST_OBJECT(OFF/ON)", &algo3_, 1);
+        //add_trackbar("DO_ROUGH_SEARCH    (OFF/ON)", &algo4_, 1);
+        //add_trackbar("x", &x_, 100);
+        //add_trackbar("y", &y_, 100);
+        add_trackbar("switch(OFF/ON)", &switch_, 1);
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat res = image;
+        if (!cascade_.empty() && switch_)
         {
-            Mat show;
-            curve_.copyTo(show);
-            if (state_ < cut_RESET)
-                rectangle(show, Point( rect_.x, rect_.y ), Point(rect_.x + rect_.width, rect_.y + rect_.height ), Scalar(0, 255, 0), 1);
-            else
-            {
-                if (cut_SAVE == state_)
-                {
-                    putText(show, (os << " saved!", os).str(), Point(0, 20), cv::FONT_HERSHEY_DUPLEX, 1.0, CV_RGB(118, 185, 0));
-                }
-                state_ = cut_IDLE;
-            }
-            for_each(posrect_.begin(), posrect_.end(),
-                     [&](Rect& rect){
-                        rectangle(show, Point( rect.x, rect.y ), Point(rect.x + rect.width, rect.y + rect.height ), Scalar(0, 0, 255), 1);
-                     });
-            imshow(name_, show);
+            vector<Rect> objs;
+            cascade_.detectMultiScale(image, objs, scalefactor_/100.+1, minneighbros_,
+                                      (algo1_ << 0)|(algo2_ << 1)|(algo2_ << 2)|(algo3_ << 3),
+                                      Size(scaled(x_), scaled(y_)));
+            draw_([=](){
+                Mat show = res.clone();
+                int i = 0;
+                for_each(objs.begin(), objs.end(),
+                         [&](const Rect& rect){
+                            static const Scalar colors[] =
+                            {
+                                Scalar(0,0,0),
+                                Scalar(255,0,0),
+                                Scalar(255,128,0),
+                                Scalar(255,255,0),
+                                Scalar(0,255,0),
+                                Scalar(0,128,255),
+                                Scalar(0,255,255),
+                                Scalar(0,0,255),
+                                Scalar(255,0,255)
+                            };
+                            rectangle(show, rect, colors[++i%8], 1, LINE_AA);
+                         });
+                return show;
+            });
         }
-        */
-        show();
-        if (cut_SAVE == state_)
-            state_ = cut_IDLE;
+        else
+        {
+            display(res);
+        }
+
+        return res;
     }
-    void show()
+    int switch_ = true;
+    int x_;
+    int y_;
+    int scalefactor_;
+    int minneighbros_;
+    int algo1_, algo2_, algo3_, algo4_;
+    CascadeClassifier cascade_;
+};
+
+class exec_filter : public itf_filter
+{
+public:
+    exec_filter(const string& name) : itf_filter(name)
     {
-        if (posrect_.empty() && state_ == cut_IDLE)
+    }
+protected:
+    virtual Mat _filter(Mat& image)
+    {
+        Mat res;
+        if (apply_)
+            apply_(image);
+        display(image);
+        return image;
+    }
+    function<void(Mat)> apply_;
+};
+
+itf_filter* createFilter(const char* filter, const string& name)
+{
+#define BRANCH(nameX)   \
+    if (0 == strcasecmp(#nameX, filter))   \
+    {   \
+        return (itf_filter*)new nameX##_filter(name);  \
+    }
+    CVTOOL_FILTERS(BRANCH)
+#undef BRANCH
+    return NULL;
+}
+
+// every name createFilter knows, in the same order.
+const vector<string>& filter_names()
+{
+#define NAME(nameX) #nameX,
+    static const char* names[] = { CVTOOL_FILTERS(NAME) };
+#undef NAME
+    static const vector<string> v(names, names + sizeof(names) / sizeof(names[0]));
+    return v;
+}
+
+void filter_graph::open(const string& cmd)
+{
+    if (cmd.empty())
+        return;
+    cmd_ += (cmd_.empty() ? "" : ",") + cmd;
+    string cmds = cmd;
+    {
+        char* p = (char*)&cmds.at(0);
+        while (*p)
         {
-            imshow(name_, curve_);
-            return;
+            if (*p == ',')
+                *p = '\0';
+            ++p;
         }
-        Mat show;
-        curve_.copyTo(show);
-        if (state_ > cut_IDLE && state_ < cut_RESET)
+    }
+    const char* p = cmds.c_str();
+    const char* ep = p + cmds.size();
+    while (p < ep)
+    {
+        sptr_filter filter(createFilter(p, p));
+        if (filter)
+            push(filter);
+        else
+            cout << "unknown " << p << endl;
+        p += strlen(p) + 1;
+    }
+}
+
+bool filter_graph::save(const string& path) const
+{
+    FileStorage fs(path, FileStorage::WRITE);
+    if (!fs.isOpened())
+        return false;
+    fs << "graph" << cmd_;
+    fs << "stages" << "[";
+    for_each(filters_.begin(), filters_.end(),
+             [&](const sptr_filter& filter){
+                fs << "{" << "name" << filter->name_ << "params" << "[";
+                const vector<itf_filter::param>& params = filter->params();
+                for_each(params.begin(), params.end(),
+                         [&](const itf_filter::param& p){
+                            fs << "{" << "trackbar" << p.label << "value" << *p.value << "}";
+                         });
+                fs << "]" << "}";
+             });
+    fs << "]";
+    return true;
+}
+
+// opens the saved graph unless one is already open, then restores
+// the trackbars stage by stage in creation order.
+bool filter_graph::load(const string& path)
+{
+    FileStorage fs(path, FileStorage::READ);
+    if (!fs.isOpened())
+        return false;
+    if (filters_.empty())
+        open((string)fs["graph"]);
+    FileNode stages = fs["stages"];
+    size_t i = 0;
+    for (FileNodeIterator it = stages.begin(); it != stages.end() && i < filters_.size(); ++it, ++i)
+    {
+        FileNode values = (*it)["params"];
+        const vector<itf_filter::param>& params = filters_[i]->params();
+        size_t j = 0;
+        for (FileNodeIterator jt = values.begin(); jt != values.end() && j < params.size(); ++jt, ++j)
         {
-            rectangle(show, Point( rect_.x, rect_.y ), Point(rect_.x + rect_.width, rect_.y + rect_.height ), Scalar(0, 255, 0), 1);
+            if ((string)(*jt)["trackbar"] != params[j].label)
+            {
+                cout << "skip " << path << " stage " << i << " trackbar " << j << endl;
+                continue;
+            }
+            *params[j].value = (int)(*jt)["value"];
+            if (!itf_filter::headless())
+                setTrackbarPos(params[j].label, params[j].window, *params[j].value);
         }
-        if (cut_SAVE == state_)
+    }
+    for (size_t j = 0; j < version_.size(); ++j)
+        version_[j] = ++gen_;
+    invalidate(0);
+    return true;
+}
+
+void filter_graph::print_stats(ostream& os) const
+{
+    const double ms = 1e-6;
+    ios::fmtflags flags = os.flags();
+    streamsize precision = os.precision();
+    os << left << setw(32) << "stage" << right
+       << setw(8) << "calls"
+       << setw(10) << "p50 ms" << setw(10) << "p95 ms"
+       << setw(10) << "p99 ms" << setw(10) << "max ms"
+       << setw(10) << "reused"
+       << "  output" << "\n";
+    int64 reused = 0;
+    for_each(filters_.begin(), filters_.end(),
+             [&](const sptr_filter& filter){
+                const stage_stats& st = filter->stats();
+                const latency_histogram& h = st.latency;
+                os << left << setw(32) << filter->name_.substr(0, filter->name_.find(" -=>")).substr(0, 31)
+                   << right << setw(8) << h.count() << fixed << setprecision(3)
+                   << setw(10) << h.percentile(.50) * ms
+                   << setw(10) << h.percentile(.95) * ms
+                   << setw(10) << h.percentile(.99) * ms
+                   << setw(10) << h.max_value() * ms
+                   << setw(10) << st.reused
+                   << "  " << st.size.width << "x" << st.size.height
+                   << " " << type_name(st.type) << "\n";
+                reused += st.reused;
+             });
+    os << "allocations avoided: " << reused << "\n";
+    os.flags(flags);
+    os.precision(precision);
+    os.flush();
+}
+
+bool filter_graph::dump_stats(const string& path) const
+{
+    FileStorage fs(path, FileStorage::WRITE);
+    if (!fs.isOpened())
+        return false;
+    fs << "graph" << cmd_;
+    int64 reused = 0;
+    fs << "stages" << "[";
+    for_each(filters_.begin(), filters_.end(),
+             [&](const sptr_filter& filter){
+                const stage_stats& st = filter->stats();
+                const latency_histogram& h = st.latency;
+                fs << "{" << "name" << filter->name_.substr(0, filter->name_.find(" -=>"))
+                   << "calls" << (double)h.count()
+                   << "mean_ns" << h.mean()
+                   << "p50_ns" << (double)h.percentile(.50)
+                   << "p95_ns" << (double)h.percentile(.95)
+                   << "p99_ns" << (double)h.percentile(.99)
+                   << "max_ns" << (double)h.max_value()
+                   << "width" << st.size.width
+                   << "height" << st.size.height
+                   << "type" << type_name(st.type)
+                   << "reused" << (double)st.reused
+                   << "allocated" << (double)st.allocated
+                   << "}";
+                reused += st.reused;
+             });
+    fs << "]";
+    fs << "allocations_avoided" << (double)reused;
+    return true;
+}
+
+// streaming
+// the stages of a graph are split into groups, each group runs on its
+// own thread, frames are handed on through spsc_queue. frame N+1 can be
+// in an early group while frame N is in a later one. results come out
+// of pop() in the order they were pushed.
+class filter_pipeline
+{
+public:
+    filter_pipeline(filter_graph& graph, int groups, size_t depth = 4)
+        : graph_(graph), seq_(0), closed_(false), done_(false)
+    {
+        size_t n = graph_.size();
+        groups = max(1, min(groups, (int)max(n, (size_t)1)));
+        for (int i = 0; i <= groups; ++i)
+            queues_.push_back(shared_ptr<spsc_queue<filter_graph::frame> >(
+                                new spsc_queue<filter_graph::frame>(depth)));
+        for (int i = 0; i < groups; ++i)
+        {
+            size_t begin = n * i / groups;
+            size_t end = n * (i + 1) / groups;
+            workers_.push_back(thread(&filter_pipeline::run, this, i, begin, end));
+        }
+    }
+    ~filter_pipeline()
+    {
+        close();
+        Mat res;
+        while (pop(res))
+            ;
+        for_each(workers_.begin(), workers_.end(),
+                 [](thread& t){
+                    t.join();
+                 });
+    }
+    // blocks while the first group is busy.
+    void push(Mat image)
+    {
+        filter_graph::frame f;
+        f.seq = seq_++;
+        f.image = image;
+        f.tmp = image;
+        queues_.front()->push(f);
+    }
+    // no more frames; pop() returns false once the rest are drained.
+    void close()
+    {
+        if (closed_)
+            return;
+        closed_ = true;
+        filter_graph::frame f;
+        f.seq = -1;
+        queues_.front()->push(f);
+    }
+    bool pop(Mat& res)
+    {
+        if (done_)
+            return false;
+        filter_graph::frame f;
+        queues_.back()->pop(f);
+        if (f.seq < 0)
         {
-            putText(show, saved_name_, Point(0, 20), cv::FONT_HERSHEY_DUPLEX, 1.0, CV_RGB(118, 185, 0));
+            done_ = true;
+            return false;
         }
-        for_each(posrect_.begin(), posrect_.end(),
-                     [&](Rect& rect){
-                        rectangle(show, Point( rect.x, rect.y ), Point(rect.x + rect.width, rect.y + rect.height ), Scalar(0, 0, 255), 1);
-                     });
-        imshow(name_, show);
+        res = f.image;
+        return true;
     }
-    virtual Mat _filter(Mat& image)
+protected:
+    void run(int i, size_t begin, size_t end)
     {
-        curve_ = image;
-        state_ = cut_IDLE;
-        //rect_ = Rect();
-        /**
-        if (cutrect_.empty())
-            imshow(name_, curve_);
-        else
+        for (;;)
         {
-            Mat show;
-            curve_.copyTo(show);
-            rectangle(show, Point(cutrect_.x, cutrect_.y ), Point(cutrect_.x + cutrect_.width, cutrect_.y + cutrect_.height ), Scalar(0, 0, 255), 1);
-            imshow(name_, show);
+            filter_graph::frame f;
+            queues_[i]->pop(f);
+            if (f.seq >= 0)
+                graph_.filter_range(f, begin, end);
+            queues_[i + 1]->push(f);
+            if (f.seq < 0)
+                break;
         }
-        */
-        show();
-        return image;
     }
-    Rect fullrect_;
-    Rect rect_;
-    Rect cutrect_;
-    vector<Rect> posrect_;
-    enum {
-        cut_IDLE,
-        cut_PREEDIT,
-        cut_EDIT,
-        cut_FIN,
-        cut_RESET,
-        cut_SAVE,
-    } state_;
-    Mat curve_;
-    string saved_name_;
-    bool use_save_;
+    filter_graph& graph_;
+    int64 seq_;
+    bool closed_;
+    bool done_;
+    vector<shared_ptr<spsc_queue<filter_graph::frame> > > queues_;
+    vector<thread> workers_;
 };
 
-typedef cut2_filter anno_filter;
-
-class crop_filter : public cut_filter
+// frame parallel
+// K replicas of one graph, each with its own thread. frame i goes to
+// replica i % K and results are taken back in the same round robin, so
+// they come out in order. only for graphs without state across frames.
+class filter_replicas
 {
 public:
-    crop_filter(const string& name) : cut_filter(name)
+    filter_replicas(const filter_graph& graph, int replicas, size_t depth = 2)
+        : seq_(0), pop_(0), closed_(false), done_(false)
     {
-        use_save_  = false;
-        apply([this](Mat, Mat crop){
-              if (state_ == cut_FIN)
-              {
-                  update_next_(crop);
-                  graph_->update_origin(crop);
-              }
-        });
+        replicas = max(1, replicas);
+        for (int i = 0; i < replicas; ++i)
+        {
+            graphs_.push_back(shared_ptr<filter_graph>(new filter_graph));
+            graphs_.back()->replicate(graph);
+            ins_.push_back(shared_ptr<spsc_queue<filter_graph::frame> >(
+                                new spsc_queue<filter_graph::frame>(depth)));
+            outs_.push_back(shared_ptr<spsc_queue<filter_graph::frame> >(
+                                new spsc_queue<filter_graph::frame>(depth)));
+        }
+        for (int i = 0; i < replicas; ++i)
+            workers_.push_back(thread(&filter_replicas::run, this, i));
+    }
+    ~filter_replicas()
+    {
+        close();
+        Mat res;
+        while (pop(res))
+            ;
+        for_each(workers_.begin(), workers_.end(),
+                 [](thread& t){
+                    t.join();
+                 });
+    }
+    void push(Mat image)
+    {
+        filter_graph::frame f;
+        f.seq = seq_++;
+        f.image = image;
+        ins_[f.seq % ins_.size()]->push(f);
+    }
+    void close()
+    {
+        if (closed_)
+            return;
+        closed_ = true;
+        filter_graph::frame f;
+        f.seq = -1;
+        for_each(ins_.begin(), ins_.end(),
+                 [&](shared_ptr<spsc_queue<filter_graph::frame> >& q){
+                    q->push(f);
+                 });
+    }
+    bool pop(Mat& res)
+    {
+        if (done_)
+            return false;
+        filter_graph::frame f;
+        outs_[pop_++ % outs_.size()]->pop(f);
+        if (f.seq < 0)
+        {
+            done_ = true;
+            return false;
+        }
+        res = f.image;
+        return true;
     }
+    size_t size() const { return graphs_.size(); }
+    const filter_graph& replica(size_t i) const { return *graphs_[i]; }
 protected:
-    virtual Mat _filter(Mat& image)
+    void run(size_t i)
     {
-        Mat res = image;
-        cut_filter::_filter(image);
-
-        if (!cutrect_.empty() && !cut_.empty())
+        filter_graph& graph = *graphs_[i];
+        for (;;)
         {
-            curve_(cutrect_).copyTo(cut_);
-            res = cut_;
-            graph_->update_origin(cut_);
+            filter_graph::frame f;
+            ins_[i]->pop(f);
+            if (f.seq >= 0)
+                f.image = graph.filter(f.image);
+            outs_[i]->push(f);
+            if (f.seq < 0)
+                break;
         }
-        return res;
     }
-    Mat crop_;
+    int64 seq_;
+    int64 pop_;
+    bool closed_;
+    bool done_;
+    vector<shared_ptr<filter_graph> > graphs_;
+    vector<shared_ptr<spsc_queue<filter_graph::frame> > > ins_;
+    vector<shared_ptr<spsc_queue<filter_graph::frame> > > outs_;
+    vector<thread> workers_;
 };
 
-class zoom_filter : public itf_filter
+// sources
+// where the frames of a graph come from. read() gives a frame the
+// caller may keep, false at the end of the input.
+class itf_source
 {
 public:
-    zoom_filter(const string& name) : itf_filter(name)
+    virtual ~itf_source() {}
+    virtual bool read(Mat& frame) = 0;
+    // reads which found no frame decoded yet.
+    virtual int64 underruns() const { return 0; }
+    // the next read() returns frame n. false if the source can not seek.
+    virtual bool seek(int64 n) { (void)n; return false; }
+    // the number of the frame last read, -1 before the first.
+    virtual int64 position() const { return -1; }
+    // -1 if unknown.
+    virtual int64 frame_count() const { return -1; }
+};
+
+typedef shared_ptr<itf_source> sptr_source;
+
+// keyframes and frame count of an input, so a seek starts decoding at
+// the keyframe before the target instead of at the first frame.
+struct seek_index
+{
+    seek_index() : count(-1), all_keys(true) {}
+    bool build(const string& input);
+    int64 key_before(int64 n) const
     {
-        x_ = 100;
-        y_ = 100;
-        inter_ = 1;
-        createTrackbar("zoom x(%)", name_, &x_, 400, itf_filter::update_, this);
-        createTrackbar("zoom y(%)", name_, &y_, 400, itf_filter::update_, this);
-        createTrackbar("interpola:\n"
-            "INTER_NEAREST        = 0,\n"
-            "INTER_LINEAR         = 1,\n"
-            "INTER_CUBIC          = 2,\n"
-            "INTER_AREA           = 3,\n"
-            "INTER_LANCZOS4       = 4,\n"
-            "INTER_LINEAR_EXACT = 5, \n"
-            "INTER_NEAREST_EXACT  = 6,\n"
-            "INTER_MAX            = 7,\n", name_,
-            &inter_, 7, itf_filter::update_, this);
+        if (all_keys)
+            return n;
+        vector<int64>::const_iterator it = upper_bound(keys.begin(), keys.end(), n);
+        return it == keys.begin() ? 0 : *(it - 1);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    int64 count;
+    // image sequences, and videos whose packets could not be listed;
+    // then the backend finds the keyframe itself.
+    bool all_keys;
+    vector<int64> keys;
+};
+
+inline bool seek_index::build(const string& input)
+{
+    count = -1;
+    all_keys = true;
+    keys.clear();
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
     {
-        Mat res;
-        setTrackbarMin("zoom x(%)", name_, 50);
-        setTrackbarMin("zoom y(%)", name_, 50);
-        if (x_ != 100 || y_ != 100)
-            resize(image, res, Size(), x_/100., y_/100., inter_);
-        else
-            res = image;
-        graph_->update_origin(res);
-        imshow(name_, res);
-        return res;
+        // raw mode hands out packets without decoding them.
+        VideoCapture raw;
+        vector<int> params;
+        params.push_back(CAP_PROP_FORMAT);
+        params.push_back(-1);
+        if (raw.open(input, CAP_FFMPEG, params))
+        {
+            int64 n = 0;
+            for (; raw.grab(); ++n)
+            {
+                if (raw.get(CAP_PROP_LRF_HAS_KEY_FRAME) != 0)
+                    keys.push_back(n);
+            }
+            if (!keys.empty() && keys.front() == 0)
+            {
+                count = n;
+                all_keys = false;
+                return true;
+            }
+            keys.clear();
+        }
     }
-    int x_;
-    int y_;
-    int inter_;
-};
+#endif
+    VideoCapture cap(input);
+    if (!cap.isOpened())
+        return false;
+    count = (int64)cap.get(CAP_PROP_FRAME_COUNT);
+    if (count <= 0)
+        count = -1;
+    return true;
+}
 
-// apply
-class contours_filter : public itf_filter
+class capture_source : public itf_source
 {
 public:
-	contours_filter(const string& name) : itf_filter(name)
-	{
-		threshold_ = 20;
-		retr_ = 1;
-		showpoly_ = 1;
-		showcontours_ = 1;
-		showconvexHull_ = 0;
-		showarea_ = 0;
-		last_max_area_ = 0;
-		createTrackbar("threshold*.001", name_, &threshold_, 200, itf_filter::update_, this);
-		createTrackbar("show poly(OFF/ON)", name_, &showpoly_, 1, itf_filter::update_, this);
-		createTrackbar("show contours(OFF/ON)", name_, &showcontours_, 1, itf_filter::update_, this);
-		createTrackbar("show area(OFF/MAX)", name_, &showarea_, 1, itf_filter::update_, this);
-		createTrackbar("show convexHull(OFF/ON)", name_, &showconvexHull_, 1, itf_filter::update_, this);
-		createTrackbar("RETR:\n"
-			"0 - RETR_EXTERNAL \n"
-			"1 - RETR_LIST\n"
-			"2 - RETR_CCOMP\n"
-			"3 - RETR_TREE\n"
-			"4 - RETR_FLOODFILL\n", name_,
-			&retr_, 4, itf_filter::update_, this);
-	}
+    explicit capture_source(const string& input) : input_(input), pos_(-1)
+    {
+        cap_.open(input);
+    }
+    bool isOpened() const { return cap_.isOpened(); }
+    virtual bool read(Mat& frame)
+    {
+        // still held by a graph or a sample_writer, decode into a new one.
+        if (frame.u && frame.u->refcount > 1)
+            frame.release();
+        if (!cap_.read(frame) || frame.empty())
+            return false;
+        ++pos_;
+        return true;
+    }
+    // from the keyframe before n, grab() up to n. FFmpeg still decodes
+    // every grabbed frame, only the conversion to BGR is left out.
+    virtual bool seek(int64 n)
+    {
+        const seek_index& index = this->index();
+        if (index.count > 0)
+            n = min(n, index.count - 1);
+        n = max(n, (int64)0);
+        int64 k = index.key_before(n);
+        if (!cap_.set(CAP_PROP_POS_FRAMES, (double)k))
+            return false;
+        for (int64 i = k; i < n; ++i)
+        {
+            if (!cap_.grab())
+                return false;
+        }
+        pos_ = n - 1;
+        return true;
+    }
+    virtual int64 position() const { return pos_; }
+    virtual int64 frame_count() const { return index().count; }
+    // listed on the first seek or frame_count(), it reads the whole file.
+    // streams are not listed, reading them to the end would not return.
+    const seek_index& index() const
+    {
+        call_once(indexed_, [this](){
+            if (input_.find("://") == string::npos)
+                index_.build(input_);
+        });
+        return index_;
+    }
+    VideoCapture& capture() { return cap_; }
 protected:
-	virtual Mat _filter(Mat& image)
-	{
-		vector<vector<Point> > contours;
-		findContours(image, contours, retr_, CHAIN_APPROX_SIMPLE);
-		vector<Point> approx;
-
-		Mat show = graph_->origin().clone();
-		/// Z#20250303
-		int area = 0;
-		if (!show.empty())
-		{
-			area = show.rows * show.cols;
-			if (area != last_max_area_)
-			{
-				last_max_area_ = area;
-				if (showarea_ > 0)
-					showarea_ = min(last_max_area_, showarea_);
-				setTrackbarMax("show area(OFF/MAX)", name_, last_max_area_);
-			}
-		}
-		else
-		{
-			showarea_ = 0;
-			last_max_area_ = 0;
-			setTrackbarMax("show area(OFF/MAX)", name_, 1);
-		}
-
-		// test each contour
-		if (showpoly_)
-			for (size_t i = 0; i < contours.size(); i++)
-			{
-				approxPolyDP(contours[i], approx, arcLength(contours[i], true)*threshold_ / 1000., true);
-				polylines(show, approx, true, Scalar(255, 0, 0), 2, LINE_AA);
-			}
-		if (showcontours_)
-			drawContours(show, contours, -1, Scalar(0, 255, 0), 1, LINE_AA);
-		if (showconvexHull_)
-		{
-			for (size_t i = 0; i < contours.size(); i++)
-			{
-				std::vector<cv::Point> hull;
-				auto& points = contours[i];
-				cv::convexHull(points, hull);
-				for (size_t i = 0; i < hull.size() && hull.size() > 5; i++)
-				{
-					cv::line(show, hull[i], hull[(i + 1) % hull.size()], cv::Scalar(0, 0, 255), 3, LINE_AA);
-				}
-			}
-		}
-		if (showarea_)
-		{
-			for (size_t i = 0; i< contours.size(); i++) 
-			{
-				using namespace cv;
-				auto& src = show;
-				double area = contourArea(contours[i]);
-				double length = arcLength(contours[i], true);
-
-				if (area < showarea_) {
-					continue;
-				}
-				cout << "area = " << area << ", length = " << length << endl;
-				RotatedRect rrt = minAreaRect(contours[i]);// ȡСӾ
-
-				Point2f pt[4];
-				rrt.points(pt);
-				line(src, pt[0], pt[1], Scalar(128, 128, 0), 8, 8);
-				line(src, pt[1], pt[2], Scalar(128, 128, 0), 8, 8);
-				line(src, pt[2], pt[3], Scalar(128, 128, 0), 8, 8);
-				line(src, pt[3], pt[0], Scalar(128, 128, 0), 8, 8);
-				Point  center = rrt.center;
-				circle(src, center, 2, Scalar(0, 0, 128), 8, 8); // СӾεĵ
-			}
-		}
-		imshow(name_, show);
-		return image;
-	}
-	int threshold_;
-	int retr_;
-	int showpoly_;
-	int showcontours_;
-	int showconvexHull_;
-	int showarea_;
-	int last_max_area_;
+    VideoCapture cap_;
+    string input_;
+    mutable once_flag indexed_;
+    mutable seek_index index_;
+    int64 pos_;
 };
 
-typedef contours_filter convexHull_filter;
-
-class match_filter : public cut_filter
+// decodes ahead of the consumer on its own thread, into a ring of depth
+// frames. a slot is decoded into again once the consumer has dropped it,
+// so at a fixed size the decoder keeps writing the same buffers.
+class prefetch_source : public itf_source
 {
 public:
-    match_filter(const string& name) : cut_filter(name, " (select) ")
+    prefetch_source(sptr_source src, size_t depth = 8)
+        : src_(src), ring_(max(depth, (size_t)1)), pos_ring_(ring_.size(), -1),
+          head_(0), count_(0), eof_(false), stop_(false), underruns_(0),
+          pos_(-1), seek_(-1), gen_(0)
     {
-        use_save_ = false;
-        use_mask_ = false;
-        image_window_ = "Match Image " + name_;
-        result_window_ = "Result window " + name_;
-        namedWindow(image_window_, WINDOW_AUTOSIZE );
-        namedWindow(result_window_, WINDOW_AUTOSIZE );
-        createTrackbar("Method: \n 0: SQDIFF \n 1: SQDIFF NORMED \n 2: TM CCORR \n 3: TM CCORR NORMED \n 4: TM COEFF \n 5: TM COEFF NORMED",
-                        image_window_, &match_method_, max_Trackbar_, MatchingMethod, this);
-        createTrackbar("threshold*.001%", image_window_, &threshold, 10000, MatchingMethod, this);
+        worker_ = thread(&prefetch_source::run, this);
+    }
+    ~prefetch_source()
+    {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        worker_.join();
+    }
+    virtual bool read(Mat& frame)
+    {
+        unique_lock<mutex> lock(mutex_);
+        if (count_ == 0 && !eof_)
+            ++underruns_;
+        cond_.wait(lock, [this](){ return count_ > 0 || eof_; });
+        if (count_ == 0)
+            return false;
+        frame = ring_[head_];
+        pos_ = pos_ring_[head_];
+        head_ = (head_ + 1) % ring_.size();
+        --count_;
+        cond_.notify_all();
+        return true;
+    }
+    virtual int64 underruns() const
+    {
+        lock_guard<mutex> lock(mutex_);
+        return underruns_;
+    }
+    // drops the frames decoded ahead, the decoder thread seeks.
+    virtual bool seek(int64 n)
+    {
+        {
+            lock_guard<mutex> lock(mutex_);
+            count_ = 0;
+            eof_ = false;
+            seek_ = max(n, (int64)0);
+            ++gen_;
+        }
+        cond_.notify_all();
+        return true;
+    }
+    virtual int64 position() const
+    {
+        lock_guard<mutex> lock(mutex_);
+        return pos_;
     }
+    virtual int64 frame_count() const { return src_->frame_count(); }
 protected:
-    virtual Mat _filter(Mat& image)
+    void run()
     {
-        if (!apply_)
-            apply([&](Mat res, Mat sel){
-                  img_ = res;
-                  if (!sel.empty())
-                      templ_ = sel;
-                  _MatchingMethod();
-				  if (is_on_mouse_)
-				  {
-					  setWindowProperty(result_window_, 5, 0);
-					  setWindowProperty(image_window_, 5, 0);
-				  }
-            });
-        return cut_filter::_filter(image);
+        for (;;)
+        {
+            Mat slot;
+            size_t tail;
+            int64 gen;
+            int64 seek = -1;
+            {
+                unique_lock<mutex> lock(mutex_);
+                cond_.wait(lock, [this](){
+                    return stop_ || seek_ >= 0 || (!eof_ && count_ < ring_.size());
+                });
+                if (stop_)
+                    return;
+                swap(seek, seek_);
+                gen = gen_;
+                tail = (head_ + count_) % ring_.size();
+                slot = ring_[tail];
+                ring_[tail] = Mat();
+            }
+            if (seek >= 0 && !src_->seek(seek))
+                cout << "can not seek to frame " << seek << endl;
+            // still held downstream, let the decoder allocate a new one.
+            if (slot.u && slot.u->refcount > 1)
+                slot.release();
+            bool ok = src_->read(slot);
+            {
+                lock_guard<mutex> lock(mutex_);
+                // a seek came in while decoding, this frame is from before it.
+                if (gen != gen_)
+                    continue;
+                if (ok)
+                {
+                    ring_[tail] = slot;
+                    pos_ring_[tail] = src_->position();
+                    ++count_;
+                }
+                else
+                    eof_ = true;
+            }
+            cond_.notify_all();
+        }
     }
-	virtual void _on_mouse(int event, int x, int y, int flags, void* ctx)
-	{
-		is_on_mouse_ = true;
-		cut_filter::_on_mouse(event, x, y, flags, ctx);
-		is_on_mouse_ = false;
-	}
-    static void MatchingMethod(int, void* ctx)
+    sptr_source src_;
+    vector<Mat> ring_;
+    vector<int64> pos_ring_;
+    size_t head_;
+    size_t count_;
+    bool eof_;
+    bool stop_;
+    int64 underruns_;
+    int64 pos_;
+    int64 seek_;
+    int64 gen_;
+    mutable mutex mutex_;
+    condition_variable cond_;
+    thread worker_;
+};
+
+// numbered images, a glob, a directory or a list file, decoded by
+// several threads with imread. a decoder takes the next path not yet
+// taken, at most depth past the frame the consumer waits for, and the
+// frames are handed out in order.
+class sequence_source : public itf_source
+{
+public:
+    sequence_source(const vector<string>& paths, int decoders = 0, size_t depth = 0)
+        : paths_(paths), depth_(depth), next_(0), issue_(0), gen_(0), pos_(-1),
+          underruns_(0), stop_(false)
     {
-        ((match_filter*)ctx)->_MatchingMethod();
+        if (decoders <= 0)
+            decoders = max(getNumberOfCPUs(), 1);
+        // two per decoder at least, or some would wait for the consumer.
+        depth_ = max(depth_, (size_t)decoders * 2);
+        for (int i = 0; i < decoders; ++i)
+            workers_.push_back(thread(&sequence_source::run, this));
     }
-    void _MatchingMethod()
+    ~sequence_source()
     {
-        Mat img_display;
-        if (templ_.empty())
-            return;
-        img_.copyTo(img_display);
-        if (img_.type() != templ_.type()
-            && (img_.type() == CV_8UC1 && templ_.type() == CV_8UC3))
         {
-            Mat tmp;
-            cvtColor(templ_, tmp, CV_BGR2GRAY);
-            templ_ = tmp;
+            lock_guard<mutex> lock(mutex_);
+            stop_ = true;
         }
-        int result_cols =  img_.cols - templ_.cols + 1;
-        int result_rows = img_.rows - templ_.rows + 1;
-        result_.create( result_rows, result_cols, CV_32FC1 );
-        bool method_accepts_mask = (CV_TM_SQDIFF == match_method_ || match_method_ == CV_TM_CCORR_NORMED);
-        if (use_mask_ && method_accepts_mask)
+        cond_.notify_all();
+        for (size_t i = 0; i < workers_.size(); ++i)
+            workers_[i].join();
+    }
+    // the images of input in order, false if input is none of
+    // "name%04d.png", "dir/*.jpg", a directory, or a .txt/.lst of paths.
+    static bool list(const string& input, vector<string>& paths);
+    // the pattern is handed to snprintf: one %d, with an optional width,
+    // and %% only.
+    static bool numbered(const string& input)
+    {
+        int n = 0;
+        for (size_t i = 0; i < input.size(); ++i)
         {
-            matchTemplate(img_, templ_, result_, match_method_, mask_);
+            if (input[i] != '%')
+                continue;
+            if (++i < input.size() && input[i] == '%')
+                continue;
+            while (i < input.size() && isdigit((uchar)input[i]))
+                ++i;
+            if (i == input.size() || input[i] != 'd' || ++n > 1)
+                return false;
         }
-        else
+        return n == 1;
+    }
+    virtual bool read(Mat& frame)
+    {
+        unique_lock<mutex> lock(mutex_);
+        for (;;)
         {
-            matchTemplate(img_, templ_, result_, match_method_);
+            if (next_ >= (int64)paths_.size())
+                return false;
+            if (!ready_.count(next_))
+                ++underruns_;
+            cond_.wait(lock, [this](){ return ready_.count(next_) > 0; });
+            map<int64, Mat>::iterator it = ready_.find(next_);
+            Mat m = it->second;
+            ready_.erase(it);
+            int64 i = next_++;
+            cond_.notify_all();
+            if (m.empty())
+            {
+                cout << "can not read " << paths_[i] << endl;
+                continue;
+            }
+            frame = m;
+            pos_ = i;
+            return true;
         }
-        if (!(match_method_ & 1))
-            normalize(result_, result_, 0, 1, NORM_MINMAX, -1, Mat());
-        double minVal; double maxVal; Point minLoc; Point maxLoc;
-        Point matchLoc;
-        double matchVal;
-        minMaxLoc(result_, &minVal, &maxVal, &minLoc, &maxLoc, Mat());
-        if (match_method_  == TM_SQDIFF || match_method_ == TM_SQDIFF_NORMED)
+    }
+    virtual int64 underruns() const
+    {
+        lock_guard<mutex> lock(mutex_);
+        return underruns_;
+    }
+    // frames being decoded for before n are dropped when they finish.
+    virtual bool seek(int64 n)
+    {
         {
-            matchLoc = minLoc;
-            matchVal = minVal;
+            lock_guard<mutex> lock(mutex_);
+            n = max((int64)0, min(n, (int64)paths_.size()));
+            ready_.clear();
+            next_ = issue_ = n;
+            ++gen_;
         }
-        else
+        cond_.notify_all();
+        return true;
+    }
+    virtual int64 position() const
+    {
+        lock_guard<mutex> lock(mutex_);
+        return pos_;
+    }
+    virtual int64 frame_count() const { return (int64)paths_.size(); }
+protected:
+    void run()
+    {
+        for (;;)
         {
-            matchLoc = maxLoc;
-            matchVal = maxVal;
+            int64 i;
+            int64 gen;
+            {
+                unique_lock<mutex> lock(mutex_);
+                cond_.wait(lock, [this](){
+                    return stop_ || (issue_ < (int64)paths_.size() && issue_ < next_ + (int64)depth_);
+                });
+                if (stop_)
+                    return;
+                i = issue_++;
+                gen = gen_;
+            }
+            // an unreadable file is handed out empty, read() skips it.
+            Mat m;
+            try
+            {
+                m = imread(paths_[i], IMREAD_COLOR);
+            }
+            catch (const cv::Exception&)
+            {
+            }
+            {
+                lock_guard<mutex> lock(mutex_);
+                if (gen != gen_)
+                    continue;
+                ready_[i] = m;
+            }
+            cond_.notify_all();
         }
-        if (0 == threshold)
+    }
+    vector<string> paths_;
+    size_t depth_;
+    map<int64, Mat> ready_;
+    // the frame read() returns next, and the next one a decoder takes.
+    int64 next_;
+    int64 issue_;
+    int64 gen_;
+    int64 pos_;
+    int64 underruns_;
+    bool stop_;
+    mutable mutex mutex_;
+    condition_variable cond_;
+    vector<thread> workers_;
+};
+
+inline bool sequence_source::list(const string& input, vector<string>& paths)
+{
+    paths.clear();
+    size_t dot = input.find_last_of('.');
+    string ext = dot == string::npos ? string() : input.substr(dot + 1);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == "txt" || ext == "lst")
+    {
+        ifstream fin(input.c_str());
+        if (!fin)
+            return false;
+        size_t slash = input.find_last_of("/\\");
+        string dir = slash == string::npos ? string() : input.substr(0, slash + 1);
+        string line;
+        while (getline(fin, line))
         {
-            rectangle(img_display, matchLoc, Point(matchLoc.x + templ_.cols , matchLoc.y + templ_.rows ), Scalar::all(0), 1, LINE_AA, 0 );
-            rectangle(result_, matchLoc, Point(matchLoc.x + templ_.cols , matchLoc.y + templ_.rows ), Scalar::all(0), 1, LINE_AA, 0 );
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (line.empty() || line[0] == '#')
+                continue;
+            // relative to the list file.
+            bool absolute = line[0] == '/' || line[0] == '\\' || (line.size() > 1 && line[1] == ':');
+            paths.push_back(absolute ? line : dir + line);
         }
-        else
+        return !paths.empty();
+    }
+    if (numbered(input))
+    {
+        // as VideoCapture, the first of 0..4 that exists starts it.
+        char path[4096];
+        int first = 0;
+        for (; first < 5; ++first)
         {
-            static const Scalar colors[] =
-            {
-                Scalar(0,0,0),
-                Scalar(255,0,0),
-                Scalar(255,128,0),
-                Scalar(255,255,0),
-                Scalar(0,255,0),
-                Scalar(0,128,255),
-                Scalar(0,255,255),
-                Scalar(0,0,255),
-                Scalar(255,0,255)
-            };
-            float* it = (float*)result_.data;
-            const int cxr = result_.cols * result_.rows;
-            double threshold1000 = threshold / 100000.;
-            for (int i = 0; i < cxr; ++i, ++it)
+            snprintf(path, sizeof(path), input.c_str(), first);
+            if (utils::fs::exists(path))
+                break;
+        }
+        if (first == 5)
+            return false;
+        for (int i = first; ; ++i)
+        {
+            snprintf(path, sizeof(path), input.c_str(), i);
+            if (!utils::fs::exists(path))
+                break;
+            paths.push_back(path);
+        }
+        return !paths.empty();
+    }
+    vector<String> found;
+    if (input.find_first_of("*?") != string::npos)
+        glob(input, found, false);
+    else if (utils::fs::isDirectory(input))
+    {
+        static const char* exts[] = { "png", "jpg", "jpeg", "bmp", "tif", "tiff", "webp",
+                                      "pgm", "ppm", "pbm", "pnm", "jp2", "exr", "hdr" };
+        vector<String> all;
+        glob(input, all, false);
+        for (size_t i = 0; i < all.size(); ++i)
+        {
+            string name = all[i];
+            size_t dot = name.find_last_of('.');
+            if (dot == string::npos)
+                continue;
+            string ext = name.substr(dot + 1);
+            transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            for (size_t k = 0; k < sizeof(exts) / sizeof(exts[0]); ++k)
             {
-                if (fabs(*it - matchVal) <= threshold1000)
+                if (ext == exts[k])
                 {
-                    Point pt(i % result_.cols, i / result_.cols);
-                    rectangle( img_display, pt, Point(pt.x + templ_.cols , pt.y + templ_.rows), colors[i%8], 1, LINE_AA, 0 );
-                    //rectangle( result, matchLoc, Point( pt.x + templ.cols , pt.y + templ.rows ), Scalar::all(0), 1, LINE_AA, 0 );
+                    found.push_back(all[i]);
+                    break;
                 }
             }
         }
-        imshow(image_window_, img_display);
-        imshow(result_window_, result_);
-        return;
     }
-    bool use_mask_ = false;
-    Mat img_, templ_, mask_, result_;
-    string image_window_;
-    string result_window_;
-    int match_method_ = 0;
-    int max_Trackbar_ = 5;
-    int threshold = 0;
-    bool init = false;
-	bool is_on_mouse_ = false;
-};
+    else
+        return false;
+    sort(found.begin(), found.end());
+    paths.assign(found.begin(), found.end());
+    return !paths.empty();
+}
 
-class cascade_filter : public itf_filter
+// frames piped to stdin, raw frames of a given size and format, or y4m.
+// each frame is one fread straight into the Mat the graph gets, or for
+// y4m into a reused planar buffer converted to BGR; no demuxer, no codec.
+class stdin_source : public itf_source
 {
 public:
-    cascade_filter(const string& name) : itf_filter(name)
+    // raw frames of size and type (CV_8UC1/3/4), or y4m if size is empty.
+    explicit stdin_source(Size size = Size(), int type = CV_8UC3)
+        : size_(size), type_(type), y4m_(size.area() == 0), chroma_(420), pos_(-1), ok_(true)
     {
-        algo1_ = algo2_ = algo3_ = algo4_ = 0;
-        algo2_ = 1;
-        x_ = 15;
-        y_ = 15;
-        scalefactor_ = 15;
-        minneighbros_ = 3;
-        cascade_.load(samples::findFile("cascade/cascade.xml"));
-        //createTrackbar("scalefactor*.01 + 1", name_, &scalefactor_, 100, itf_filter::update_, this);
-        //createTrackbar("min neighbros", name_, &minneighbros_, 10, itf_filter::update_, this);
-        //createTrackbar("DO_CANNY_PRUNING   (OFF/ON)", name_, &algo1_, 1, itf_filter::update_, this);
-        //createTrackbar("SCALE_IMAGE        (OFF/ON)", name_, &algo2_, 1, itf_filter::update_, this);
-        //createTrackbar("FIND_BIGGEST_OBJECT(OFF/ON)", name_, &algo3_, 1, itf_filter::update_, this);
-        //createTrackbar("DO_ROUGH_SEARCH    (OFF/ON)", name_, &algo4_, 1, itf_filter::update_, this);
-        //createTrackbar("x", name_, &x_, 100, itf_filter::update_, this);
-        //createTrackbar("y", name_, &y_, 100, itf_filter::update_, this);
-        createTrackbar("switch(OFF/ON)", name_, &switch_, 1, itf_filter::update_, this);
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        // big reads go past the buffer into the Mat, headers stay cheap.
+        setvbuf(stdin, 0, _IOFBF, 1 << 20);
+        if (y4m_)
+            ok_ = read_y4m_header();
+    }
+    bool isOpened() const { return ok_; }
+    Size size() const { return size_; }
+    virtual bool read(Mat& frame)
+    {
+        if (!ok_)
+            return false;
+        // still held by a graph or a sample_writer, read into a new one.
+        if (frame.u && frame.u->refcount > 1)
+            frame.release();
+        if (!y4m_)
+        {
+            frame.create(size_, type_);
+            if (!read_all(frame.data, frame.total() * frame.elemSize()))
+                return false;
+        }
+        else
+        {
+            // FRAME and its parameters up to the newline.
+            char tag[5];
+            if (!read_all((uchar*)tag, 5) || memcmp(tag, "FRAME", 5) != 0)
+                return false;
+            int c;
+            while ((c = getc(stdin)) != '\n')
+            {
+                if (c == EOF)
+                    return false;
+            }
+            if (!read_all(yuv_.data, yuv_.total()))
+                return false;
+            int h = size_.height;
+            if (chroma_ == 0)
+                yuv_.copyTo(frame);
+            else if (chroma_ == 420)
+                cvtColor(yuv_, frame, COLOR_YUV2BGR_I420);
+            else
+            {
+                // planar 4:4:4, interleaved for cvtColor.
+                Mat planes[3] = { yuv_.rowRange(0, h), yuv_.rowRange(h, 2 * h), yuv_.rowRange(2 * h, 3 * h) };
+                merge(planes, 3, yuv444_);
+                cvtColor(yuv444_, frame, COLOR_YUV2BGR);
+            }
+        }
+        ++pos_;
+        return true;
     }
+    virtual int64 position() const { return pos_; }
 protected:
-    virtual Mat _filter(Mat& image)
+    static bool read_all(uchar* p, size_t n)
     {
-        Mat res = image;
-        if (!cascade_.empty() && switch_)
+        return fread(p, 1, n, stdin) == n;
+    }
+    // YUV4MPEG2 W<w> H<h> [C<colorspace>] ..., only 8 bit 420, 444 and mono.
+    bool read_y4m_header()
+    {
+        string line;
+        int c;
+        while ((c = getc(stdin)) != '\n')
         {
-            vector<Rect> objs;
-            Mat show = res.clone();
-            cascade_.detectMultiScale(image, objs, scalefactor_/100.+1, minneighbros_,
-                                      (algo1_ << 0)|(algo2_ << 1)|(algo2_ << 2)|(algo3_ << 3),
-                                      Size(x_, y_));
-            int i = 0;
-            for_each(objs.begin(), objs.end(),
-                     [&](Rect& rect){
-                        static const Scalar colors[] =
-                        {
-                            Scalar(0,0,0),
-                            Scalar(255,0,0),
-                            Scalar(255,128,0),
-                            Scalar(255,255,0),
-                            Scalar(0,255,0),
-                            Scalar(0,128,255),
-                            Scalar(0,255,255),
-                            Scalar(0,0,255),
-                            Scalar(255,0,255)
-                        };
-                        rectangle(show, rect, colors[++i%8], 1, LINE_AA);
-                     });
-            imshow(name_, show);
+            if (c == EOF)
+                return false;
+            line += (char)c;
+        }
+        istringstream is(line);
+        string tok;
+        if (!(is >> tok) || tok != "YUV4MPEG2")
+        {
+            cout << "stdin: not y4m" << endl;
+            return false;
+        }
+        string cs = "420";
+        while (is >> tok)
+        {
+            if (tok[0] == 'W')
+                size_.width = atoi(tok.c_str() + 1);
+            else if (tok[0] == 'H')
+                size_.height = atoi(tok.c_str() + 1);
+            else if (tok[0] == 'C')
+                cs = tok.substr(1);
         }
+        if (cs.compare(0, 4, "mono") == 0 && cs.size() == 4)
+            chroma_ = 0;
+        // 420jpeg, 420paldv, 420mpeg2, but not the 420p10 of 10 bit.
+        else if (cs.compare(0, 3, "420") == 0 && !(cs.size() > 4 && cs[3] == 'p' && isdigit(cs[4])))
+            chroma_ = 420;
+        else if (cs == "444")
+            chroma_ = 444;
         else
         {
-            imshow(name_, res);
+            cout << "stdin: y4m C" << cs << " is not supported, use 420, 444 or mono" << endl;
+            return false;
         }
+        if (size_.area() == 0 || (chroma_ == 420 && (size_.width % 2 || size_.height % 2)))
+            return false;
+        int rows = chroma_ == 0 ? size_.height : chroma_ == 420 ? size_.height * 3 / 2 : size_.height * 3;
+        yuv_.create(rows, size_.width, CV_8UC1);
+        return true;
+    }
+    Size size_;
+    int type_;
+    bool y4m_;
+    // 0 mono, 420 or 444.
+    int chroma_;
+    Mat yuv_;
+    Mat yuv444_;
+    int64 pos_;
+    bool ok_;
+};
 
-        return res;
+#ifndef _WIN32
+// a ring of frames in POSIX shared memory, written by another process.
+// a 128 byte header, then slots of a 64 byte slot header and one frame
+// of rows x stride bytes each. all frames have the format of the header.
+// the writer fills slot n % slots, sets its seq to n, then write_seq to
+// n + 1. the reader keeps read_seq at the frame it holds; a writer that
+// blocks never writes a slot read_seq + slots or more ahead of it. one
+// that drops overwrites older frames, the reader skips to the newest,
+// but leaves the slot of read_seq alone: frame n of that slot is not
+// written, its seq stays below n, and the reader steps over it.
+struct shm_ring
+{
+    struct header
+    {
+        char magic[8];
+        int32_t slots;
+        int32_t rows;
+        int32_t cols;
+        int32_t type;
+        int64 stride;
+        int64 slot_bytes;
+        atomic<int64> write_seq;
+        atomic<int64> read_seq;
+        atomic<int32_t> closed;
+        char pad[60];
+    };
+    struct slot
+    {
+        // -1 while being written.
+        atomic<int64> seq;
+        char pad[56];
+    };
+    static const size_t header_size = 128;
+    shm_ring() : base_(0), size_(0), owner_(false) {}
+    ~shm_ring() { detach(); }
+    // the writer side, replaces a ring of the same name.
+    bool create(const string& name, int rows, int cols, int type, int slots)
+    {
+        detach();
+        int64 stride = (int64)cols * CV_ELEM_SIZE(type);
+        int64 slot_bytes = (int64)sizeof(slot) + ((rows * stride + 63) & ~(int64)63);
+        size_t size = header_size + (size_t)(slot_bytes * slots);
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0600);
+        if (fd < 0)
+            return false;
+        if (ftruncate(fd, (off_t)size) != 0 || !map_(fd, size))
+        {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        ::close(fd);
+        name_ = name;
+        owner_ = true;
+        header* h = head();
+        memset((void*)h, 0, header_size);
+        strcpy(h->magic, "CVTSHM1");
+        h->slots = slots;
+        h->rows = rows;
+        h->cols = cols;
+        h->type = type;
+        h->stride = stride;
+        h->slot_bytes = slot_bytes;
+        h->write_seq.store(0);
+        h->read_seq.store(-1);
+        h->closed.store(0);
+        for (int i = 0; i < slots; ++i)
+            at(i)->seq.store(-1);
+        return true;
     }
-    int switch_ = true;
-    int x_;
-    int y_;
-    int scalefactor_;
-    int minneighbros_;
-    int algo1_, algo2_, algo3_, algo4_;
-    CascadeClassifier cascade_;
+    // the reader side.
+    bool attach(const string& name)
+    {
+        detach();
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= header_size && map_(fd, (size_t)st.st_size);
+        ::close(fd);
+        if (!ok || strcmp(head()->magic, "CVTSHM1") != 0
+            || size_ < header_size + (size_t)(head()->slot_bytes * head()->slots))
+        {
+            detach();
+            return false;
+        }
+        name_ = name;
+        return true;
+    }
+    // the writer side: copies m into the next slot. blocking waits for
+    // the reader to move on, otherwise the oldest slot is overwritten.
+    bool write(const Mat& m, bool block)
+    {
+        header* h = head();
+        if (!h || m.rows != h->rows || m.cols != h->cols || m.type() != h->type)
+            return false;
+        int64 n = h->write_seq.load(memory_order_relaxed);
+        while (block && n >= h->read_seq.load(memory_order_acquire) + h->slots)
+            this_thread::sleep_for(chrono::microseconds(500));
+        slot* s;
+        for (;; ++n)
+        {
+            s = at(n);
+            int64 old = s->seq.load(memory_order_relaxed);
+            // seq_cst with the reader: it either sees -1 and retries, or
+            // this sees its read_seq.
+            s->seq.store(-1);
+            int64 r = h->read_seq.load();
+            if (block || r < 0 || r >= n || (n - r) % h->slots != 0)
+                break;
+            s->seq.store(old, memory_order_release);
+        }
+        Mat dst = frame(n);
+        m.copyTo(dst);
+        s->seq.store(n, memory_order_release);
+        h->write_seq.store(n + 1, memory_order_release);
+        return true;
+    }
+    void detach()
+    {
+        // the reader returns the frames left, then ends.
+        if (base_ && owner_)
+            head()->closed.store(1, memory_order_release);
+        if (base_)
+            munmap(base_, size_);
+        if (owner_)
+            shm_unlink(name_.c_str());
+        base_ = 0;
+        size_ = 0;
+        owner_ = false;
+    }
+    bool is_open() const { return base_ != 0; }
+    header* head() const { return (header*)base_; }
+    slot* at(int64 n) const
+    {
+        return (slot*)(base_ + header_size + (size_t)((n % head()->slots) * head()->slot_bytes));
+    }
+    // frame n, a header on the slot.
+    Mat frame(int64 n) const
+    {
+        header* h = head();
+        return Mat(h->rows, h->cols, h->type, (uchar*)at(n) + sizeof(slot), (size_t)h->stride);
+    }
+protected:
+    bool map_(int fd, size_t size)
+    {
+        void* p = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            return false;
+        base_ = (uchar*)p;
+        size_ = size;
+        return true;
+    }
+    uchar* base_;
+    size_t size_;
+    string name_;
+    bool owner_;
 };
 
-class exec_filter : public itf_filter
+// frames of a shm_ring handed out as Mat headers on its slots. the frame
+// read last stays valid until the next read(), which gives the slot back
+// to the writer. with copy, e.g. for frames in flight through a
+// pipeline, each frame is copied out instead.
+class shm_source : public itf_source
 {
 public:
-    exec_filter(const string& name) : itf_filter(name)
+    explicit shm_source(const string& name, bool copy = false)
+        : copy_(copy), next_(0), pos_(-1), dropped_(0), underruns_(0)
     {
+        if (ring_.attach(name))
+            ring_.head()->read_seq.store(-1);
     }
-protected:
-    virtual Mat _filter(Mat& image)
+    ~shm_source()
     {
-        Mat res;
-        if (apply_)
-            apply_(image);
-        imshow(name_, image);
-        return image;
+        // do not keep a blocking writer waiting on us.
+        if (ring_.is_open())
+            ring_.head()->read_seq.store(INT64_MAX / 2);
     }
-    function<void(Mat)> apply_;
+    bool is_open() const { return ring_.is_open(); }
+    virtual bool read(Mat& frame)
+    {
+        if (!ring_.is_open())
+            return false;
+        shm_ring::header* h = ring_.head();
+        bool waited = false;
+        for (;;)
+        {
+            int64 w = h->write_seq.load(memory_order_acquire);
+            if (w <= next_)
+            {
+                if (h->closed.load(memory_order_acquire))
+                    return false;
+                waited = true;
+                this_thread::sleep_for(chrono::microseconds(500));
+                continue;
+            }
+            // lapped by a writer that drops, carry on from the newest.
+            if (w - next_ > h->slots - 1)
+            {
+                dropped_ += w - 1 - next_;
+                next_ = w - 1;
+            }
+            h->read_seq.store(next_);
+            int64 seq = ring_.at(next_)->seq.load();
+            // left out by a dropping writer, the slot was held.
+            if (seq >= 0 && seq < next_)
+            {
+                ++dropped_;
+                ++next_;
+                continue;
+            }
+            if (seq != next_)
+                continue;
+            break;
+        }
+        if (waited)
+            ++underruns_;
+        Mat m = ring_.frame(next_);
+        if (copy_)
+        {
+            // still held downstream, copy into a new one.
+            if (frame.u && frame.u->refcount > 1)
+                frame.release();
+            m.copyTo(frame);
+        }
+        else
+            frame = m;
+        pos_ = next_++;
+        return true;
+    }
+    virtual int64 underruns() const { return underruns_; }
+    virtual int64 position() const { return pos_; }
+    // frames the writer overwrote before they were read.
+    int64 dropped() const { return dropped_; }
+    Size size() const { return ring_.is_open() ? Size(ring_.head()->cols, ring_.head()->rows) : Size(); }
+protected:
+    shm_ring ring_;
+    bool copy_;
+    int64 next_;
+    int64 pos_;
+    int64 dropped_;
+    int64 underruns_;
 };
+#endif
 
-itf_filter* createFilter(const char* filter, const string& name)
+// the recorded outputs of one stage of a frame_store, in frame order.
+// stage -1 gives the recorded input frames.
+class store_source : public itf_source
 {
-#define BRANCH(nameX)   \
-    if (0 == strcasecmp(#nameX, filter))   \
-    {   \
-        return (itf_filter*)new nameX##_filter(name);  \
+public:
+    store_source(shared_ptr<frame_store> store, int stage)
+        : store_(store), stage_(stage), frames_(store->frames(stage)), next_(0), pos_(-1)
+    {
     }
-    if (0 == strcasecmp("threshold", filter))
-    {
-        return (itf_filter*)new threshold_filter(name);
-    }
-    if (0 == strcasecmp("morphology", filter))
-    {
-        return (itf_filter*)new morphology_filter(name);
-    }
-    BRANCH(Canny);
-    BRANCH(medianBlur);
-    BRANCH(GaussianBlur);
-    BRANCH(blur);
-    BRANCH(bilateral);
-    BRANCH(box);
-    BRANCH(sqrBox);
-    BRANCH(Sobel);
-    BRANCH(Scharr);
-    BRANCH(Laplacian);
-    BRANCH(pyrDown);
-    BRANCH(pyrUp);
-
-    BRANCH(warpAffine);
-    BRANCH(warpPerspective);
-    BRANCH(warpPolar);
-
-    BRANCH(cornerMinEigenVal);
-    BRANCH(cornerHarris);
-    BRANCH(cornerEigenValsAndVecs);
-    BRANCH(preCornerDetect);
-    BRANCH(norm_minmax);
-
-    BRANCH(HoughLines);
-    BRANCH(HoughLinesP);
-    BRANCH(HoughCircles);
-
-    BRANCH(channel);
-    BRANCH(bgr2gray);
-    BRANCH(gray2mask);
-    BRANCH(range);
-    BRANCH(colormap);
-    BRANCH(cut);
-    BRANCH(cut2);
-    BRANCH(anno);
-    BRANCH(crop);
-    BRANCH(zoom);
-
-    BRANCH(feature);
-    BRANCH(blob);
-
-    BRANCH(deskew);
-    BRANCH(dem);
-    BRANCH(distrans);
-
-	BRANCH(convexHull);
-    BRANCH(contours);
-    BRANCH(match);
-    BRANCH(cascade);
-    return NULL;
-}
+    virtual bool read(Mat& frame)
+    {
+        if (next_ >= frames_.size())
+            return false;
+        pos_ = frames_[next_++];
+        frame = store_->get(pos_, stage_);
+        return true;
+    }
+    // n is a frame number, the next recorded one from it on is read.
+    virtual bool seek(int64 n)
+    {
+        next_ = lower_bound(frames_.begin(), frames_.end(), n) - frames_.begin();
+        return true;
+    }
+    virtual int64 position() const { return pos_; }
+    virtual int64 frame_count() const { return frames_.empty() ? 0 : frames_.back() + 1; }
+protected:
+    shared_ptr<frame_store> store_;
+    int stage_;
+    vector<int64> frames_;
+    size_t next_;
+    int64 pos_;
+};
 
-void filter_graph::open(const string& cmd)
+// keeps every frame read in a frame_cache, a seek to a frame still in it
+// returns that one and the source carries on from the frame after.
+class cache_source : public itf_source
 {
-    string cmds = cmd;
+public:
+    cache_source(sptr_source src, shared_ptr<frame_cache> cache)
+        : src_(src), cache_(cache), pos_(-1), skip_to_(-1), want_(-1)
     {
-        char* p = (char*)&cmds.at(0);
-        while (*p)
+    }
+    virtual bool read(Mat& frame)
+    {
+        if (want_ >= 0)
         {
-            if (*p == ',')
-                *p = '\0';
-            ++p;
+            frame_cache::key k = { want_, -1, 0 };
+            frame_cache::entry e;
+            if (!next_.empty() || cache_->get(k, e))
+            {
+                frame = next_.empty() ? e.out : next_;
+                next_ = Mat();
+                pos_ = want_++;
+                return true;
+            }
+            // the first miss after a seek moves the source.
+            skip_to_ = want_;
+            want_ = -1;
+            // at the last frame the seek is clamped, the loop below skips it.
+            if (!src_->seek(skip_to_))
+                return false;
         }
+        // a new Mat, the cache keeps the last one.
+        Mat m;
+        do
+        {
+            if (!src_->read(m))
+                return false;
+        } while (src_->position() >= 0 && src_->position() < skip_to_);
+        skip_to_ = -1;
+        frame = m;
+        pos_ = src_->position();
+        frame_cache::key k = { pos_, -1, 0 };
+        frame_cache::entry e;
+        e.out = frame;
+        cache_->put(k, e);
+        return true;
     }
-    const char* p = cmds.c_str();
-    const char* ep = p + cmds.size();
-    while (p < ep)
+    // to a cached frame the source is not moved, read() goes on from
+    // the cache and seeks the source at the first frame it does not hold.
+    virtual bool seek(int64 n)
     {
-        sptr_filter filter(createFilter(p, p));
-        if (filter)
-            push(filter);
-        else
-            cout << "unknown " << p << endl;
-        p += strlen(p) + 1;
+        frame_cache::key k = { n, -1, 0 };
+        frame_cache::entry e;
+        if (n >= 0 && cache_->get(k, e))
+        {
+            next_ = e.out;
+            want_ = n;
+            return true;
+        }
+        next_ = Mat();
+        want_ = -1;
+        skip_to_ = -1;
+        return src_->seek(n);
     }
-}
+    virtual int64 underruns() const { return src_->underruns(); }
+    virtual int64 position() const { return pos_; }
+    virtual int64 frame_count() const { return src_->frame_count(); }
+protected:
+    sptr_source src_;
+    shared_ptr<frame_cache> cache_;
+    Mat next_;
+    int64 pos_;
+    int64 skip_to_;
+    // the frame read() returns next from the cache, -1 when from src_.
+    int64 want_;
+};
 
 } // end ns cvtool
 